@@ -63,6 +63,34 @@ void handle_keyboard_uart_msg(uart_packet_t *packet, device_t *state) {
     state->last_activity[BOARD_ROLE] = time_us_64();
 }
 
+/* Other board's keyboard state changed, or it sent a full snapshot of it */
+void handle_kbd_sync_msg(uart_packet_t *packet, device_t *state) {
+    hid_keyboard_report_t combined_report;
+    bool changed;
+
+    /* If NULL MODE is active, drop all keyboard input from other board */
+    if (state->null_mode)
+        return;
+
+    if (packet->type == KBD_DELTA_MSG)
+        changed = apply_kbd_delta(packet->data, state);
+    else
+        changed = apply_kbd_snapshot(packet->data, state);
+
+    /* Periodic snapshots usually confirm what we already have, don't repeat it to the host */
+    if (!changed)
+        return;
+
+    combine_kbd_states(state, &combined_report);
+    queue_kbd_report(&combined_report, state);
+    state->last_activity[BOARD_ROLE] = time_us_64();
+}
+
+/* Other board lost track of our keyboard state */
+void handle_kbd_sync_request_msg(uart_packet_t *packet, device_t *state) {
+    send_kbd_snapshot(state);
+}
+
 /* Function handles received mouse moves from the other board */
 void handle_mouse_abs_uart_msg(uart_packet_t *packet, device_t *state) {
     mouse_report_t *mouse_report = (mouse_report_t *)packet->data;
@@ -72,9 +100,17 @@ void handle_mouse_abs_uart_msg(uart_packet_t *packet, device_t *state) {
         return;
     }
 
-    queue_mouse_report(mouse_report, state);
+    /* Widen back to full range, our accumulator sums and saturates them for the host.
+       Buttons are merged with our own pointers, so neither side releases the other's. */
+    mouse_values_t values = {
+        .move_x  = mouse_report->x,
+        .move_y  = mouse_report->y,
+        .wheel   = mouse_report->wheel,
+        .pan     = mouse_report->pan,
+        .buttons = merge_mouse_buttons(state, MOUSE_SOURCE_REMOTE, mouse_report->buttons),
+    };
 
-    state->mouse_buttons   = mouse_report->buttons;
+    queue_mouse_report(&values, state);
 
     state->last_activity[BOARD_ROLE] = time_us_64();
 }
@@ -85,6 +121,9 @@ void handle_output_select_msg(uart_packet_t *packet, device_t *state) {
     if (state->tud_connected)
         release_all_keys(state);
 
+    /* Buttons held on the other board's pointer were meant for the previous output */
+    release_remote_mouse_buttons(state);
+
     restore_leds(state);
 }
 
@@ -112,6 +151,11 @@ void handle_wipe_config_msg(uart_packet_t *packet, device_t *state) {
     load_config(state);
 }
 
+/* Clear queue telemetry and report rate statistics */
+void handle_reset_stats_msg(uart_packet_t *packet, device_t *state) {
+    reset_stats(state);
+}
+
 
 /* Process consumer control message */
 void handle_consumer_control_msg(uart_packet_t *packet, device_t *state) {
@@ -171,6 +215,11 @@ void handle_api_msgs(uart_packet_t *packet, device_t *state) {
             return;
 
         memcpy(ptr, &packet->data[1], map->len);
+
+        /* Hotkeys are matched using precomputed masks, rebuild them if the table changed */
+        if (map->offset >= offsetof(device_t, config.hotkeys)
+            && map->offset < offsetof(device_t, config.hotkeys) + sizeof(state->config.hotkeys))
+            compile_hotkeys(state);
     }
     else if (packet->type == GET_VAL_MSG) {
         uart_packet_t response = {.type=GET_VAL_MSG, .data={[0] = value_idx}};
@@ -194,7 +243,19 @@ void handle_api_read_all_msg(uart_packet_t *packet, device_t *state) {
 
 /* Process heartbeat message - simplified without firmware upgrade */
 void handle_heartbeat_msg(uart_packet_t *packet, device_t *state) {
-    /* Just update the heartbeat, no firmware upgrade functionality */
+    /* Just update the heartbeat and link features, no firmware upgrade functionality */
+    update_link_peer(packet, state);
+    answer_link_ping(packet, state);
+}
+
+/* Other board told us which link features it supports */
+void handle_link_caps_msg(uart_packet_t *packet, device_t *state) {
+    update_link_caps(packet, state);
+}
+
+/* Other board answered our heartbeat, update RTT and clock offset estimates */
+void handle_link_pong_msg(uart_packet_t *packet, device_t *state) {
+    update_link_clock(packet, state);
 }
 
 
@@ -211,4 +272,5 @@ void set_active_output(device_t *state, uint8_t new_output) {
     /* If we were holding a key down and drag the mouse to another screen, the key gets stuck.
        Changing outputs = no more keypresses on the previous system. */
     release_all_keys(state);
+    release_remote_mouse_buttons(state);
 }
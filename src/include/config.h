@@ -15,7 +15,7 @@
 #include "misc.h"
 #include "screen.h"
 
-#define CURRENT_CONFIG_VERSION 8
+#define CURRENT_CONFIG_VERSION 10
 
 /*==============================================================================
  *  Configuration Data
@@ -43,5 +43,6 @@ void load_config(device_t *);
 void queue_cfg_packet(uart_packet_t *, device_t *);
 void reset_config_timer(device_t *);
 void save_config(device_t *);
+bool send_queued_hid_packet(ring_t *);
 bool validate_packet(uart_packet_t *);
 void wipe_config(void);
@@ -33,6 +33,13 @@
 
 #define RELATIVE 1
 
+/*==============================================================================
+ *  Pointer Sources
+ *==============================================================================*/
+
+#define MOUSE_SOURCE_REMOTE (MAX_DEVICES * MAX_INTERFACES) // Pointers on the other board
+#define MOUSE_SOURCES       (MOUSE_SOURCE_REMOTE + 1)
+
 /*==============================================================================
  *  Boolean States
  *==============================================================================*/
@@ -46,6 +53,8 @@
 
 #define MOUSE_BOOT_REPORT_LEN 4
 #define NUM_SCREENS 2
+#define HOTKEY_COUNT 8
+#define HOTKEY_MAX_KEYS 3
 
 /*==============================================================================
  *  Utility Macros
@@ -17,14 +17,16 @@
  *==============================================================================*/
 
 #define DMA_RX_BUFFER_SIZE 1024
-#define DMA_TX_BUFFER_SIZE 32
+#define DMA_TX_BUFFER_SIZE 128 // Per TX buffer, there are two of them
+#define DMA_TX_BUFFERS     2
+#define DMA_TX_IDLE        0xFF   // No TX buffer is being sent
 
 /*==============================================================================
  *  DMA Buffers
  *==============================================================================*/
 
 extern uint8_t uart_rxbuf[DMA_RX_BUFFER_SIZE] __attribute__((aligned(DMA_RX_BUFFER_SIZE)));
-extern uint8_t uart_txbuf[DMA_TX_BUFFER_SIZE] __attribute__((aligned(DMA_TX_BUFFER_SIZE)));
+extern uint8_t uart_txbuf[DMA_TX_BUFFERS][DMA_TX_BUFFER_SIZE] __attribute__((aligned(DMA_TX_BUFFER_SIZE)));
 
 /*==============================================================================
  *  Ring Buffer Macro
@@ -25,7 +25,10 @@
   *  UART Packet Fetching
   *  Functions to handle incoming UART packets, especially for firmware updates.
   *==============================================================================*/
+ void     consume_rx_bytes(device_t *, uint32_t);
+ void     copy_from_rx_ring(uint8_t *, uint32_t, uint32_t);
  void     fetch_packet(device_t *);
+ uint32_t find_frame_start(device_t *, uint32_t);
  uint32_t get_ptr_delta(uint32_t, device_t *);
  bool     is_start_of_packet(device_t *);
  void     request_byte(device_t *, uint32_t);
@@ -27,8 +27,8 @@ keyboard_t *get_keyboard(hid_interface_t *iface, uint8_t report_id);
  *==============================================================================*/
 
 bool key_in_report(uint8_t, const hid_keyboard_report_t *);
-bool check_f17_hotkey(const hid_keyboard_report_t *);
-bool check_null_mode_hotkey(const hid_keyboard_report_t *);
+bool check_hotkeys(device_t *, hid_keyboard_report_t *, uint8_t);
+void compile_hotkeys(device_t *);
 
 /*==============================================================================
  *  Keyboard State Management
@@ -36,6 +36,9 @@ bool check_null_mode_hotkey(const hid_keyboard_report_t *);
 void     update_kbd_state(device_t *, hid_keyboard_report_t *, uint8_t);
 void     update_remote_kbd_state(device_t *, hid_keyboard_report_t *);
 void     combine_kbd_states(device_t *, hid_keyboard_report_t *);
+bool     apply_kbd_delta(uint8_t *, device_t *);
+bool     apply_kbd_snapshot(uint8_t *, device_t *);
+void     send_kbd_snapshot(device_t *);
 
 /*==============================================================================
  *  Keyboard Report Processing
@@ -49,6 +52,7 @@ void     queue_kbd_report(hid_keyboard_report_t *, device_t *);
 void     queue_system_packet(uint8_t *, device_t *);
 void     release_all_keys(device_t *);
 void     send_consumer_control(uint8_t *, device_t *);
+bool     send_queued_kbd_report(device_t *);
 void     send_key(hid_keyboard_report_t *, device_t *);
 
 /* ==================================================== *
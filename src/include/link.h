@@ -0,0 +1,147 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "structs.h"
+
+/*==============================================================================
+ *  Link Capabilities, sent with every heartbeat
+ *==============================================================================*/
+
+/* Feature bits, once assigned a bit keeps its meaning in every future caps version */
+#define LINK_FLAG_COBS        (1 << 0) // Understands COBS framed packets with CRC-16
+#define LINK_FLAG_RELIABLE    (1 << 1) // Understands sequence numbers and ACKs, needs COBS
+#define LINK_FLAG_SPEED       (1 << 2) // Can train the link to a different baud rate, needs COBS
+#define LINK_FLAG_CLOCK       (1 << 3) // Answers heartbeats with LINK_PONG_MSG
+#define LINK_FLAG_NKRO        (1 << 4) // Reserved: accepts NKRO keyboard reports
+#define LINK_FLAG_COMPRESS    (1 << 5) // Reserved: accepts compressed payloads
+#define LINK_FLAG_KBD_SYNC    (1 << 6) // Keyboard state as versioned deltas and snapshots
+#define LINK_FLAGS_SUPPORTED  (LINK_FLAG_COBS | LINK_FLAG_RELIABLE | LINK_FLAG_SPEED | LINK_FLAG_CLOCK \
+                               | LINK_FLAG_KBD_SYNC)
+
+/* LINK_CAPS_MSG layout. Newer versions may only append, so any version >= 1 is read
+   the same way and unknown feature bits are simply not enabled. */
+#define LINK_CAPS_VERSION      1
+#define LINK_CAPS_VERSION_IDX  0       // data[], caps layout version, 0 is invalid
+#define LINK_CAPS_PAYLOAD_IDX  1       // data[], longest packet data we accept
+#define LINK_CAPS_BAUD_IDX     2       // data[], bitmask of link_baudrates[] we can run at
+#define LINK_CAPS_FEATURES_IDX 1       // data32[], LINK_FLAG_* bits
+#define LINK_BAUDRATES_SUPPORTED ((1 << LINK_BAUDRATE_COUNT) - 1)
+
+#define LINK_PEER_TIMEOUT_US   3000000 // Fall back to legacy framing if peer goes quiet
+#define LINK_PEER_VERSION_IDX  0       // Heartbeat data16[], firmware version of the sender
+#define LINK_CAPS_MAX_AGE      3       // Heartbeats without caps before we stop trusting them
+
+/*==============================================================================
+ *  COBS Framing
+ *==============================================================================*/
+
+/* Frame is COBS(type, [seq], data with trailing zeros removed, CRC-16 LE) followed by 0x00.
+   Reliable packets have LINK_RELIABLE_BIT set in the type and a 16-bit sequence number.
+   COBS adds one code byte, so the longest frame is 15 bytes, a 1-byte value takes 6. */
+#define COBS_DELIMITER    0x00
+#define COBS_CRC_LENGTH   2
+#define LINK_SEQ_LENGTH   2
+#define LINK_RELIABLE_BIT 0x80
+#define COBS_MAX_PAYLOAD  (TYPE_LENGTH + LINK_SEQ_LENGTH + PACKET_DATA_LENGTH + COBS_CRC_LENGTH)
+#define COBS_MAX_FRAME    (COBS_MAX_PAYLOAD + 2)
+#define LINK_MAX_FRAME    COBS_MAX_FRAME // Longest frame of either kind
+
+/*==============================================================================
+ *  Link Speed Training
+ *==============================================================================*/
+
+/* LINK_TRAIN_MSG data layout */
+#define LINK_TRAIN_OP_IDX      0
+#define LINK_TRAIN_RATE_IDX    1
+#define LINK_TRAIN_RESULT_IDX  2 // REPORT: intact patterns received
+#define LINK_TRAIN_PATTERN_IDX 2 // PATTERN: start of link_train_pattern
+#define LINK_TRAIN_DELAY_IDX   2 // COMMITTED: us until the sender switches, 16 bits
+
+enum link_train_op_e {
+    LINK_TRAIN_START     = 0, // From the config tool, (re)train now
+    LINK_TRAIN_PROPOSE   = 1, // Initiator asks to try a rate
+    LINK_TRAIN_ACCEPT    = 2, // Responder agrees, both switch shortly after
+    LINK_TRAIN_PATTERN   = 3, // Known test pattern sent at the trial rate
+    LINK_TRAIN_REPORT    = 4, // Responder's result, sent after both went back
+    LINK_TRAIN_COMMIT    = 5, // Move to this rate for good
+    LINK_TRAIN_COMMITTED = 6, // Got the COMMIT, switching when the delay runs out
+};
+
+#define LINK_BAUDRATE_COUNT       6       // Entries in link_baudrates[]
+#define LINK_BAUDRATE_DEFAULT_IDX 2       // SERIAL_BAUDRATE, what both boards boot with
+#define LINK_TRAIN_PATTERNS       16      // Every one of them must arrive intact to pass
+#define LINK_TRAIN_PATTERN_LENGTH 6
+
+/* Trial timing, relative to the responder queueing ACCEPT and the initiator receiving it.
+   Nothing is expected on the wire while the two boards switch, the patterns take 2.3 ms
+   at the slowest rate and both are back on the old rate before the responder reports. */
+#define LINK_TRAIN_SWITCH_US      2000    // Responder switches
+#define LINK_TRAIN_REVERT_US      12000   // Responder goes back to the old rate
+#define LINK_TRAIN_I_SWITCH_US    1000    // Initiator switches
+#define LINK_TRAIN_I_SEND_US      3000    // Initiator starts sending patterns
+#define LINK_TRAIN_I_REVERT_US    10000   // Initiator goes back to the old rate
+#define LINK_TRAIN_REPLY_US       40000   // Give up waiting for ACCEPT or REPORT
+
+/* COMMIT is resent until the other board confirms it. That board switches a fixed time after
+   the first COMMIT it got and tells us how much of that time is left, so a lost confirmation
+   can be resent before it's on the new rate. */
+#define LINK_TRAIN_COMMIT_US       8000   // Other board switches this long after the first COMMIT
+#define LINK_TRAIN_COMMIT_RETRY_US 1500   // Resend COMMIT if it's not confirmed by then
+#define LINK_TRAIN_COMMIT_TRIES    4      // Give up and stay on the current rate after that
+
+/* After training, keep an eye on errors and step down a rate if they rise */
+#define LINK_HEALTH_PERIOD_US     1000000
+#define LINK_HEALTH_MAX_ERRORS    4       // Bad frames per period we tolerate
+
+/*==============================================================================
+ *  Link Clock
+ *==============================================================================*/
+
+/* Every heartbeat doubles as a ping, carrying the low bits of its send time as a token.
+   The pong echoes it, with the time the ping arrived and how long it took to answer. */
+#define LINK_PING_TOKEN_IDX   1 // Heartbeat data16[] index
+#define LINK_PONG_RECV_IDX    0 // data32[], other board's time_us_32 when the ping arrived
+#define LINK_PONG_TOKEN_IDX   2 // data16[], token from the ping
+#define LINK_PONG_HOLD_IDX    3 // data16[], microseconds between ping arriving and pong leaving
+#define LINK_RTT_SPIKE_FACTOR 4 // RTT above smoothed RTT + this many deviations is a spike
+
+/*==============================================================================
+ *  Lookup Tables
+ *==============================================================================*/
+
+extern const uint16_t crc16_lookup_table[];
+extern const uint32_t link_baudrates[];
+extern const uint8_t link_train_pattern[];
+
+/*==============================================================================
+ *  Functions
+ *==============================================================================*/
+
+uint16_t crc16(const uint8_t *, int);
+int      cobs_encode(const uint8_t *, int, uint8_t *);
+int      cobs_decode(const uint8_t *, int, uint8_t *, int);
+uint32_t fetch_cobs_packet(device_t *, uint32_t, bool *);
+void     update_link_peer(uart_packet_t *, device_t *);
+void     update_link_caps(uart_packet_t *, device_t *);
+void     reset_link_caps(device_t *);
+void     send_link_caps(device_t *);
+void     check_link_peer(device_t *);
+int      write_link_frame(uint8_t *, uart_packet_t *, device_t *);
+bool     accept_link_packet(device_t *);
+void     process_link_acks(device_t *);
+int      retransmit_link_packets(device_t *, uint8_t *, int);
+void     reset_link_speed(device_t *);
+void     answer_link_ping(uart_packet_t *, device_t *);
+void     update_link_clock(uart_packet_t *, device_t *);
+uint64_t peer_to_local_us(uint64_t, device_t *);
+void     handle_link_train_msg(uart_packet_t *, device_t *);
@@ -17,7 +17,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <pico/util/queue.h>
+#include <pico/critical_section.h>
 #include "hid_parser.h"
 
 #include "constants.h"
@@ -37,12 +37,14 @@
 #include "flash.h"
 #include "handlers.h"
 #include "keyboard.h"
+#include "link.h"
 #include "mouse.h"
 #include "packet.h"
 #include "pinout.h"
 #include "screen.h"
 #include "serial.h"
 #include "setup.h"
+#include "stats.h"
 #include "tasks.h"
 #include "watchdog.h"
 
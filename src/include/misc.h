@@ -35,3 +35,9 @@ extern device_t global_state;
 void    blink_led(device_t *);
 void    restore_leds(device_t *);
 uint8_t toggle_led(void);
+
+/*==============================================================================
+ *  Statistics
+ *==============================================================================*/
+
+void    reset_stats(device_t *);
@@ -13,6 +13,18 @@
 #include "structs.h"
 #include "hid_parser.h"
 
+/*==============================================================================
+ *  Sensitivity and Acceleration
+ *==============================================================================*/
+
+#define MOUSE_SPEED_UNITY    16 // Speed factor that moves the cursor 1:1
+#define MOUSE_SPEED_MAX      128
+#define MOUSE_ACCEL_LUT_SIZE 72
+#define MOUSE_MOVE_LIMIT     ((1 << 18) - 1) // Largest per-report delta the scaling accepts
+#define MOUSE_ACC_FRAMES     4 // Pending motion is capped at this many reports worth
+
+extern const uint16_t mouse_accel_lut[];
+
 /*==============================================================================
  *  Data Extraction
  *==============================================================================*/
@@ -24,6 +36,11 @@ void      parse_report_descriptor(hid_interface_t *, uint8_t const *, int);
  *  Mouse Report Handling
  *==============================================================================*/
 void process_mouse_report(uint8_t *, int, uint8_t, hid_interface_t *);
-void queue_mouse_report(mouse_report_t *, device_t *);
+void queue_mouse_report(mouse_values_t *, device_t *);
 bool tud_mouse_report(uint8_t mode, uint8_t buttons, int16_t x, int16_t y, int8_t wheel, int8_t pan);
-void output_mouse_report(mouse_report_t *, device_t *);
+void output_mouse_report(mouse_values_t *, device_t *);
+uint8_t merge_mouse_buttons(device_t *, uint8_t, uint8_t);
+void release_mouse_source(device_t *, uint8_t);
+void release_remote_mouse_buttons(device_t *);
+bool send_queued_mouse_report(device_t *);
+bool merge_mouse_report(void *, const void *);
@@ -24,10 +24,41 @@
 #define START_LENGTH  2
 
 /* Packet Queue Definitions  */
-#define UART_QUEUE_LENGTH  256
-#define HID_QUEUE_LENGTH   128
-#define KBD_QUEUE_LENGTH   128
-#define MOUSE_QUEUE_LENGTH 512
+#define UART_QUEUE_LENGTH  32
+#define UART_BULK_QUEUE_LENGTH 128 // Holds a full GET_ALL_VALS answer for the other board
+#define HID_QUEUE_LENGTH   16
+#define VENDOR_QUEUE_LENGTH 128
+#define KBD_QUEUE_LENGTH   32
+#define MOUSE_QUEUE_LENGTH 16
+#define SET_REPORT_QUEUE_LENGTH 16
+
+/* Link traffic is sent in priority order, input first, config and telemetry last */
+enum uart_lane_e {
+    UART_LANE_INPUT   = 0, // Keyboard, mouse and control reports
+    UART_LANE_CONTROL = 1, // State changes, heartbeats and link housekeeping
+    UART_LANE_BULK    = 2, // Config, API answers, proxied packets
+    UART_LANES        = 3,
+};
+
+/* Bulk packets waiting longer than this may take one slot per TX buffer ahead of the rest */
+#define UART_BULK_MAX_WAIT_US 5000
+
+/* Mouse motion over the link is coalesced to one packet per USB frame */
+#define MOUSE_LINK_FRAME_US 1000
+
+/* Reliable delivery of state-changing messages over the link */
+#define LINK_TX_WINDOW        8     // Reliable packets in flight, waiting for an ACK
+#define LINK_RX_TYPES         32    // Packet types tracked for duplicate detection
+#define LINK_ACK_QUEUE_LENGTH 16    // ACKs handed over from the receiving to the sending core
+#define LINK_RETRANSMIT_US    2000  // Resend if not acknowledged within this time
+#define LINK_MAX_RETRIES      10    // Give up after this many retransmissions
+#define LINK_STALE_US         1000000 // Older sequence numbers only count as duplicates this long
+#define LINK_CLOCK_SAMPLES    8     // Ping/pong rounds the RTT and clock offset are filtered over
+
+/* Receiver processes all complete packets per pass, but yields to the USB host task
+   after this many packets or microseconds, whichever comes first */
+#define RX_PACKET_BUDGET  16
+#define RX_TIME_BUDGET_US 250
 
 /* Packet Lengths and Offsets */
 #define PACKET_LENGTH          (TYPE_LENGTH + PACKET_DATA_LENGTH + CHECKSUM_LENGTH)
@@ -45,6 +76,14 @@
 #define SYSTEM_CONTROL_LENGTH   1
 #define MODIFIER_BIT_LENGTH     8
 
+/* Keyboard state sync: [version, modifier, keys...], a delta lists the keys that toggled,
+   a snapshot all the keys that are down */
+#define KBD_SYNC_VERSION_IDX    0
+#define KBD_SYNC_MODIFIER_IDX   1
+#define KBD_SYNC_KEYS_IDX       2
+#define KBD_SYNC_MAX_KEYS       6
+#define KBD_SYNC_REQUEST_US     20000 // Don't ask for snapshots more often than this
+
 /*==============================================================================
  *  Data Structures
  *==============================================================================*/
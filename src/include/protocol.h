@@ -12,24 +12,42 @@
 
 #include <stdint.h>
 
-enum packet_type_e {
-    KEYBOARD_REPORT_MSG  = 1,
-    MOUSE_REPORT_MSG     = 2,
-    OUTPUT_SELECT_MSG    = 3,
-    KBD_SET_REPORT_MSG   = 6,
-    FLASH_LED_MSG        = 9,
-    WIPE_CONFIG_MSG      = 10,
-    HEARTBEAT_MSG        = 12,
-    GAMING_MODE_MSG      = 13,
-    CONSUMER_CONTROL_MSG = 14,
-    SYSTEM_CONTROL_MSG   = 15,
-    SAVE_CONFIG_MSG      = 18,
-    REBOOT_MSG           = 19,
-    GET_VAL_MSG          = 20,
-    SET_VAL_MSG          = 21,
-    GET_ALL_VALS_MSG     = 22,
-    PROXY_PACKET_MSG     = 23,
-};
+/*==============================================================================
+ *  Message Registry
+ *  Every message type is one line here, the enum, dispatch table, host allowlist,
+ *  TX lanes and reliability class are all generated from it. Columns are:
+ *  type, id, handler, longest payload, TX lane, allowed from host, reliable
+ *==============================================================================*/
+
+#define MESSAGE_REGISTRY(X)                                                                                  \
+    X(KEYBOARD_REPORT_MSG,   1, handle_keyboard_uart_msg,    KBD_REPORT_LENGTH,       INPUT,   false, true)  \
+    X(MOUSE_REPORT_MSG,      2, handle_mouse_abs_uart_msg,   MOUSE_REPORT_LENGTH,     INPUT,   false, false) \
+    X(OUTPUT_SELECT_MSG,     3, handle_output_select_msg,    1,                       CONTROL, false, true)  \
+    X(KBD_SET_REPORT_MSG,    6, handle_set_report_msg,       1,                       CONTROL, false, true)  \
+    X(FLASH_LED_MSG,         9, handle_flash_led_msg,        PACKET_DATA_LENGTH,      BULK,    true,  false) \
+    X(WIPE_CONFIG_MSG,      10, handle_wipe_config_msg,      PACKET_DATA_LENGTH,      BULK,    true,  true)  \
+    X(HEARTBEAT_MSG,        12, handle_heartbeat_msg,        PACKET_DATA_LENGTH,      CONTROL, false, false) \
+    X(GAMING_MODE_MSG,      13, handle_toggle_gaming_msg,    1,                       CONTROL, false, true)  \
+    X(CONSUMER_CONTROL_MSG, 14, handle_consumer_control_msg, CONSUMER_CONTROL_LENGTH, INPUT,   false, true)  \
+    X(SYSTEM_CONTROL_MSG,   15, handle_system_control_msg,   SYSTEM_CONTROL_LENGTH,   INPUT,   false, true)  \
+    X(SAVE_CONFIG_MSG,      18, handle_save_config_msg,      PACKET_DATA_LENGTH,      BULK,    true,  true)  \
+    X(REBOOT_MSG,           19, handle_reboot_msg,           PACKET_DATA_LENGTH,      BULK,    true,  false) \
+    X(GET_VAL_MSG,          20, handle_api_msgs,             PACKET_DATA_LENGTH,      BULK,    true,  false) \
+    X(SET_VAL_MSG,          21, handle_api_msgs,             PACKET_DATA_LENGTH,      BULK,    true,  false) \
+    X(GET_ALL_VALS_MSG,     22, handle_api_read_all_msg,     PACKET_DATA_LENGTH,      BULK,    true,  false) \
+    X(PROXY_PACKET_MSG,     23, handle_proxy_msg,            PACKET_DATA_LENGTH,      BULK,    true,  false) \
+    X(RESET_STATS_MSG,      24, handle_reset_stats_msg,      PACKET_DATA_LENGTH,      BULK,    true,  false) \
+    X(LINK_ACK_MSG,         25, NULL,                        LINK_SEQ_LENGTH,         CONTROL, false, false) \
+    X(LINK_TRAIN_MSG,       26, handle_link_train_msg,       PACKET_DATA_LENGTH,      CONTROL, true,  false) \
+    X(LINK_PONG_MSG,        27, handle_link_pong_msg,        PACKET_DATA_LENGTH,      CONTROL, false, false) \
+    X(LINK_CAPS_MSG,        28, handle_link_caps_msg,        PACKET_DATA_LENGTH,      CONTROL, false, false) \
+    X(KBD_DELTA_MSG,        29, handle_kbd_sync_msg,         PACKET_DATA_LENGTH,      INPUT,   false, false) \
+    X(KBD_SNAPSHOT_MSG,     30, handle_kbd_sync_msg,         PACKET_DATA_LENGTH,      INPUT,   false, false) \
+    X(KBD_SYNC_REQUEST_MSG, 31, handle_kbd_sync_request_msg, 1,                       CONTROL, false, false)
+
+#define MESSAGE_ENUM(name, id, ...) name = id,
+
+enum packet_type_e { MESSAGE_REGISTRY(MESSAGE_ENUM) };
 
 typedef enum {
     UINT8 = 0,
@@ -0,0 +1,90 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*==============================================================================
+ *  Constants
+ *==============================================================================*/
+
+/* What happens when a ring fills up. Only the consumer may move the tail, so for the
+   policies that discard old elements the producer keeps committing into the spare
+   slots above the soft limit and tells the consumer where the live data starts. */
+typedef enum {
+    RING_DROP_NEWEST = 0, // New element is discarded
+    RING_DROP_OLDEST = 1, // Oldest elements are skipped, the newest ones are kept
+    RING_SNAPSHOT    = 2, // Elements carry full state, backlog collapses to the newest one
+    RING_MERGE       = 3, // New element is folded into the newest one if merge allows it
+} ring_policy_e;
+
+/* Folds element into newest, which is still waiting in the ring. Returns false if the two
+   can't be combined, the element is then added on its own. */
+typedef bool (*ring_merge_f)(void *newest, const void *element);
+
+/*==============================================================================
+ *  Data Structures
+ *==============================================================================*/
+
+/* Queue telemetry. Enqueued, dropped and high_water are written by the producer,
+   max_wait_us by the consumer and depth is a snapshot refreshed by the stats task. */
+typedef struct {
+    uint32_t enqueued;    // Elements successfully added
+    uint32_t dropped;     // Elements lost or skipped because the ring was full
+    uint32_t depth;       // Elements waiting, as of the last refresh
+    uint32_t high_water;  // Most elements ever waiting at once
+    uint32_t max_wait_us; // Longest time an element spent in the ring
+} ring_stats_t;
+
+/* Single-producer, single-consumer ring. One core only ever adds, the other only ever
+   removes, so no locks are needed. Head and tail are free-running counters, each one
+   written by just one side, capacity must be a power of two. Skip is written by the
+   producer only, the consumer moves its tail up to it before reading. */
+typedef struct {
+    uint8_t *data;          // Element storage, capacity * elem_size bytes
+    uint32_t *stamps;       // Time each element was committed, capacity entries
+    uint16_t elem_size;     // Size of one element in bytes
+    uint16_t mask;          // Capacity - 1
+    uint16_t limit;         // Soft limit, overflow policy kicks in above it
+    uint8_t policy;         // What to do when full (ring_policy_e)
+    volatile uint32_t head; // Number of elements ever added, written by the producer
+    volatile uint32_t tail; // Number of elements ever removed, written by the consumer
+    volatile uint32_t skip; // Everything before this was superseded, written by the producer
+    volatile uint32_t reading; // Slot index + 1 the consumer is looking at, 0 if none
+    volatile uint32_t merging; // Slot index + 1 the producer is merging into, 0 if none
+    ring_merge_f merge;     // Combines elements, used with RING_MERGE only
+    ring_stats_t stats;     // Telemetry, see above
+} ring_t;
+
+/*==============================================================================
+ *  Functions
+ *==============================================================================*/
+
+void ring_init(ring_t *, void *, uint32_t *, uint16_t, uint16_t, ring_policy_e);
+void ring_set_merge(ring_t *, ring_merge_f);
+void *ring_claim(ring_t *);
+void ring_commit(ring_t *);
+void *ring_front(ring_t *);
+void ring_release(ring_t *);
+void ring_keep(ring_t *);
+uint32_t ring_front_stamp(ring_t *);
+bool ring_try_add(ring_t *, const void *);
+bool ring_try_peek(ring_t *, void *);
+bool ring_try_remove(ring_t *, void *);
+uint32_t ring_level(ring_t *);
+bool ring_is_empty(ring_t *);
+void ring_reset_stats(ring_t *);
+
+#ifdef DH_RING_SELFTEST
+void run_ring_selftest(void);
+void report_ring_selftest(void);
+#endif
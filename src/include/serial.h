@@ -28,7 +28,9 @@
  *==============================================================================*/
 
 bool get_packet_from_buffer(device_t *);
+const message_t *get_message(uint8_t);
 void process_packet(uart_packet_t *, device_t *);
-void queue_packet(const uint8_t *, enum packet_type_e, int);
+bool queue_packet(const uint8_t *, enum packet_type_e, int);
 void send_value(const uint8_t, enum packet_type_e);
 void write_raw_packet(uint8_t *, uart_packet_t *);
+void uart_tx_dma_irq_handler(void);
@@ -19,3 +19,4 @@
 void initial_setup(device_t *);
 void serial_init(void);
 void core1_main(void);
+void configure_rx_irq(void);
@@ -0,0 +1,64 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+#pragma once
+
+#include <stdint.h>
+
+/*==============================================================================
+ *  Constants
+ *==============================================================================*/
+
+/* Interval histogram is log-linear: each power of two range is split into REPORT_RATE_SUB_BINS
+   equal bins, so resolution stays around 12% from 8 kHz devices down to 125 Hz ones. Below
+   that, bins are REPORT_RATE_UNIT_US wide. The last bin takes everything from REPORT_RATE_MAX_US. */
+#define REPORT_RATE_UNIT_US    16      // Width of the narrowest bins
+#define REPORT_RATE_SUB_BITS   3       // log2 of REPORT_RATE_SUB_BINS
+#define REPORT_RATE_SUB_BINS   (1 << REPORT_RATE_SUB_BITS)
+#define REPORT_RATE_RANGE_BITS 11      // Histogram covers REPORT_RATE_UNIT_US << 11, ~32 ms
+#define REPORT_RATE_MAX_US     (REPORT_RATE_UNIT_US << REPORT_RATE_RANGE_BITS)
+#define REPORT_RATE_BINS \
+    ((REPORT_RATE_RANGE_BITS - REPORT_RATE_SUB_BITS + 1) * REPORT_RATE_SUB_BINS + 1) // Plus overflow bin
+#define REPORT_RATE_OVERFLOW   0xFFFF  // Percentile fell into the overflow bin, >= REPORT_RATE_MAX_US
+#define REPORT_RATE_IDLE_US    100000  // Longer pauses mean the device was idle, not late
+
+/*==============================================================================
+ *  Data Structures
+ *==============================================================================*/
+
+/* Inter-arrival statistics of input reports on one HID interface */
+typedef struct {
+    uint32_t last_report_us;  // Arrival time of the previous report
+    uint32_t reports;         // Number of reports received
+    uint32_t avg_interval_us; // Moving average of the interval
+    uint32_t max_interval_us; // Longest interval while streaming
+    uint32_t max_process_us;  // Longest time our own pipeline spent on one report
+    uint32_t gaps;            // Intervals more than twice as long as the average
+    uint16_t histogram[REPORT_RATE_BINS];
+} report_rate_t;
+
+/* Summary of the interface selected over the API, refreshed periodically */
+typedef struct {
+    uint8_t iface;       // Selected interface, (device address - 1) * MAX_INTERFACES + instance
+    uint16_t rate_hz;    // Effective polling rate
+    uint16_t p50_us;     // Median interval, or REPORT_RATE_OVERFLOW
+    uint16_t p99_us;     // 99th percentile interval, or REPORT_RATE_OVERFLOW
+    uint32_t max_us;     // Longest interval while streaming
+    uint32_t gaps;       // Number of late reports
+    uint32_t process_us; // Longest time spent processing one report
+} report_rate_view_t;
+
+/*==============================================================================
+ *  Functions
+ *==============================================================================*/
+
+void record_report_arrival(report_rate_t *, uint32_t);
+void record_report_processed(report_rate_t *, uint32_t);
+void reset_report_rate(report_rate_t *);
@@ -11,26 +11,48 @@
 #pragma once
 
 #include <stdint.h>
+#include "dma.h"
 #include "flash.h"
 #include "packet.h"
 #include "screen.h"
+#include "ring.h"
+#include "stats.h"
 
 typedef void (*action_handler_t)();
 
-typedef struct { // Maps message type -> message handler function
-    enum packet_type_e type;
+typedef struct { // Everything we know about a message type, see MESSAGE_REGISTRY
     action_handler_t handler;
-} uart_handler_t;
+    uint8_t length;   // Longest payload, COBS frames carrying more are rejected
+    uint8_t lane;     // UART TX lane it's sent in
+    bool from_host;   // Allowed over the configuration endpoint
+    bool reliable;    // Sent with a sequence number and ACKed when the link supports it
+    bool registered;
+} message_t;
+
+enum hotkey_action_e {
+    HOTKEY_ACTION_NONE          = 0,
+    HOTKEY_ACTION_OUTPUT_TOGGLE = 1,
+    HOTKEY_ACTION_NULL_MODE     = 2,
+};
 
 typedef struct {
-    uint8_t modifier;                 // Which modifier is pressed
-    uint8_t keys[KEYS_IN_USB_REPORT]; // Which keys need to be pressed
-    uint8_t key_count;                // How many keys are pressed
-    action_handler_t action_handler;  // What to execute when the key combination is detected
-    bool pass_to_os;                  // True if we are to pass the key to the OS too
-    bool acknowledge;                 // True if we are to notify the user about registering keypress
+    uint8_t modifier;              // Which modifier(s) need to be held, 0 = any
+    uint8_t keys[HOTKEY_MAX_KEYS]; // Which keys need to be pressed, unused slots are 0
+    uint8_t action;                // What to execute when the combination is detected (hotkey_action_e)
+    uint8_t pass_to_os;            // True if we are to pass the key to the OS too
 } hotkey_combo_t;
 
+/* Hotkey table compiled to lookup masks, so a report is matched in a single pass
+   regardless of how many hotkeys there are. Each hotkey owns one nibble: bit 0 is
+   "modifier satisfied", bits 1-3 are its key slots. */
+typedef struct {
+    uint32_t key_bits[256];      // Keycode -> slots this key satisfies
+    uint32_t modifier_bits[256]; // Modifier byte -> hotkeys whose modifier is satisfied
+    uint32_t unused_bits;        // Key slots not in use, always satisfied
+    uint32_t block_mask;         // Hotkeys whose keypress is not passed to the OS
+    uint32_t active[MAX_DEVICES]; // Hotkeys matched in each keyboard's previous report (edge detection)
+} hotkey_matcher_t;
+
 typedef struct TU_ATTR_PACKED {
     uint8_t buttons;
     int16_t x;
@@ -40,6 +62,17 @@ typedef struct TU_ATTR_PACKED {
     uint8_t mode;
 } mouse_report_t;
 
+/* Relative motion waiting to be sent to the host. Deltas are summed here instead of
+   queueing every report, so a stalled host never causes a replay of stale motion. */
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t wheel;
+    int32_t pan;
+    uint8_t buttons; // Button state the pending motion belongs to
+    bool pending;    // True if there is something to send
+} mouse_accumulator_t;
+
 
 typedef struct {
     uint8_t instance;
@@ -51,6 +84,89 @@ typedef struct {
 
 typedef enum { IDLE, READING_PACKET, PROCESSING_PACKET } receiver_state_t;
 
+/* Reliable packet sent over the link, kept until the other board acknowledges it */
+typedef struct {
+    uart_packet_t packet;
+    uint16_t seq;     // Sequence number it was sent with
+    uint8_t retries;  // Retransmissions so far
+    bool in_use;      // Waiting for an ACK
+    uint32_t sent_us; // Time of the last (re)transmission
+} link_tx_slot_t;
+
+/* Last reliable packet of a given type we received, to drop duplicates and stale retries */
+typedef struct {
+    uint16_t seq;
+    bool seen;
+    uint32_t when;
+} link_rx_t;
+
+typedef enum {
+    LINK_PHASE_IDLE,
+    LINK_PHASE_PROPOSED,   // Initiator waiting for ACCEPT
+    LINK_PHASE_TRIAL,      // Both boards switching to the trial rate and back
+    LINK_PHASE_RESULT,     // Initiator waiting for REPORT
+    LINK_PHASE_COMMITTING, // Sent COMMIT, waiting for the other board to confirm it
+    LINK_PHASE_COMMIT,     // Switching to a new rate for good
+} link_train_phase_t;
+
+/* Keyboard state we replicate to the other board */
+typedef struct {
+    uint8_t version;            // Bumped with every delta
+    hid_keyboard_report_t sent; // What the other board has, if nothing got lost
+} kbd_sync_tx_t;
+
+/* Keyboard state replicated from the other board */
+typedef struct {
+    uint8_t version;            // Version of remote_kbd_state
+    bool synced;                // False after a gap, until the next snapshot
+    uint32_t requested;         // When we last asked for a snapshot
+    uint32_t gaps;              // Deltas that didn't follow the version we had
+} kbd_sync_rx_t;
+
+/* One ping/pong round */
+typedef struct {
+    uint32_t rtt_us;
+    int32_t offset_us;
+} link_clock_sample_t;
+
+/* Round trip time and clock offset to the other board, all of it runs on core1 */
+typedef struct {
+    bool ping_pending;         // Waiting for the pong to our last heartbeat
+    volatile uint32_t ping_sent; // When it was packed for sending, written by the TX task on core0
+    link_clock_sample_t samples[LINK_CLOCK_SAMPLES];
+    uint8_t sample_idx;        // Next sample to overwrite
+    uint8_t sample_count;      // Samples collected, up to LINK_CLOCK_SAMPLES
+    uint32_t rtt_us;           // RTT of the best recent sample
+    int32_t offset_us;         // Other board's clock minus ours, from the best recent sample
+    uint32_t srtt_us;          // Smoothed RTT
+    uint32_t rttvar_us;        // Smoothed RTT deviation
+    uint32_t rtt_max_us;       // Worst RTT seen
+    uint32_t rtt_spikes;       // Rounds well above the smoothed RTT
+} link_clock_t;
+
+/* Link speed training, all of it runs on core1 */
+typedef struct {
+    link_train_phase_t phase;
+    bool initiator;            // We started this training
+    bool switched;             // Trial rate is in effect
+    bool patterns_sent;        // Initiator queued its test patterns
+    bool trained;              // Training ran since the other board showed up
+    volatile bool requested;   // Config tool asked for training, possibly from core0
+    uint8_t rate_idx;          // Rate in use, index into link_baudrates
+    uint8_t trial_idx;         // Rate being tried, or the one we're committing to
+    uint8_t best_idx;          // Fastest rate that passed so far
+    uint8_t ceiling_idx;       // Don't try anything faster, lowered when errors forced a step down
+    uint8_t good_patterns;     // Responder: patterns received intact during the trial
+    uint8_t commit_tries;      // COMMITs sent for trial_idx without a confirmation
+    bool health_settled;       // A full health period passed since the last rate change
+    uint32_t switch_at;        // When to switch to trial_idx
+    uint32_t send_at;          // Initiator: when to send the patterns
+    uint32_t revert_at;        // When to go back to rate_idx
+    uint32_t deadline;         // When to give up waiting for an answer
+    uint32_t health_checked;   // Time of the last error rate check
+    uint32_t health_errors;    // link_rx_errors at that time
+} link_speed_t;
+
 typedef struct {
     uint32_t address;         // Address we're sending to the other box
     uint32_t checksum;
@@ -67,11 +183,12 @@ typedef struct {
     uint8_t force_kbd_boot_protocol;
 
     uint8_t kbd_led_as_indicator;
-    uint8_t hotkey_toggle;
+    uint8_t enable_acceleration;
 
     uint8_t enforce_ports;
 
     output_t output[NUM_SCREENS];
+    hotkey_combo_t hotkeys[HOTKEY_COUNT];
     uint32_t _reserved;
 
     // Keep checksum at the end of the struct
@@ -94,24 +211,78 @@ typedef struct {
 
     hid_keyboard_report_t local_kbd_states[MAX_DEVICES]; // Store keyboard states
     hid_keyboard_report_t remote_kbd_state;              // Store combined remote keyboard state
+    kbd_sync_tx_t kbd_sync_tx;                           // Keyboard state we send to the other board
+    kbd_sync_rx_t kbd_sync_rx;                           // Keyboard state we get from it
     uint8_t max_kbd_idx;                                 // Store largest kbd_idx seen
 
-    int16_t mouse_buttons; // Store and update the state of mouse buttons
+    int16_t mouse_buttons;     // Store and update the state of mouse buttons (all pointers merged)
+    uint8_t mouse_source_buttons[MOUSE_SOURCES]; // Buttons held, per pointer source
+    int32_t mouse_remainder_x; // Sub-count motion left over after scaling, Q8
+    int32_t mouse_remainder_y; // (-||-)
+
+    hotkey_matcher_t hotkeys; // Hotkey table from config, compiled for fast matching
 
     config_t config;       // Device configuration, loaded from flash or defaults used
-    queue_t hid_queue_out; // Queue that stores outgoing hid messages
-    queue_t kbd_queue;     // Queue that stores keyboard reports
-    queue_t mouse_queue;   // Queue that stores mouse reports
-    queue_t uart_tx_queue; // Queue that stores outgoing packets
+    ring_t hid_queue_out;  // Queue that stores outgoing consumer and system control reports
+    ring_t vendor_queue;   // Queue that stores config replies for the vendor interface
+    ring_t kbd_queue;      // Queue that stores keyboard reports
+    ring_t mouse_queue;    // Queue that stores mouse button transitions
+    ring_t set_report_queue; // Set reports received from the host, handed over to core1
+
+    mouse_accumulator_t mouse_acc;   // Relative mouse motion pending for the host
+    critical_section_t mouse_lock;   // Guards mouse_acc, it's shared between cores
+    mouse_accumulator_t mouse_link_acc; // Relative mouse motion pending for the other board
+    uint64_t mouse_link_last_tx;        // Timestamp of the last mouse packet sent over UART
+    ring_t uart_tx_queue[UART_LANES]; // Queues that store outgoing packets, one per priority lane
+    uint32_t deferred_mask;           // Types in deferred_values[] still to be sent, one bit each
+    uint8_t deferred_values[LINK_RX_TYPES]; // Newest value per type that didn't fit its lane
 
     hid_interface_t iface[MAX_DEVICES][MAX_INTERFACES]; // Store info about HID interfaces
+    report_rate_t report_rate[MAX_DEVICES][MAX_INTERFACES]; // Report timing per HID interface
+    report_rate_view_t report_rate_view;                    // Summary of one of them, for the API
     uart_packet_t in_packet;
 
     /* DMA */
     uint32_t dma_ptr;             // Stores info about DMA ring buffer last checked position
+    uint32_t rx_consumed;         // Bytes taken out of the RX ring, dma_ptr without the wrap
+    uint32_t rx_backlog_max;      // Most unprocessed bytes seen in the RX ring at once
+    volatile uint32_t rx_bytes;   // Bytes received, updated from the write address by the RX interrupt
+    volatile uint32_t rx_irq_us;  // Time of the last RX interrupt
+    uint32_t rx_bytes_seen;       // Value of rx_bytes when the receiver last ran
+    uint32_t rx_latency_max_us;   // Longest time from a frame landing to the receiver handling it
     uint32_t dma_rx_channel;      // DMA RX channel we're using to receive
     uint32_t dma_control_channel; // DMA channel that controls the RX transfer channel
     uint32_t dma_tx_channel;      // DMA TX channel we're using to send
+    volatile uint16_t tx_len[DMA_TX_BUFFERS]; // Bytes waiting in each TX buffer, 0 when free
+    volatile uint8_t tx_active;   // TX buffer being sent by DMA, or DMA_TX_IDLE
+    uint8_t tx_fill;              // TX buffer to be filled next
+
+    /* Link */
+    uint32_t link_flags;          // Link features both boards support (LINK_FLAG_*)
+    uint8_t link_baud_mask;       // Baud rates both boards can run at, bits of link_baudrates[]
+    uint8_t link_max_payload;     // Longest packet data both boards accept
+    uint8_t link_peer_caps;       // Caps version the other board sent, 0 if none yet
+    uint32_t link_peer_seen;      // Time of the last heartbeat from the other board
+    uint16_t link_peer_version;   // Firmware version in the last heartbeat from the other board
+    uint8_t link_caps_age;        // Heartbeats since the other board last sent its caps
+    uint16_t link_tx_seq;         // Next sequence number for reliable packets
+    link_tx_slot_t link_tx_window[LINK_TX_WINDOW]; // Reliable packets waiting for an ACK
+    link_rx_t link_rx[LINK_RX_TYPES]; // Last reliable packet received, per type
+    ring_t link_ack_queue;        // ACKs received on core1, for the sender on core0
+    uint16_t in_seq;              // Sequence number of the packet in in_packet
+    bool in_reliable;             // True if in_packet was sent reliably and needs an ACK
+    uint32_t link_retransmits;    // Reliable packets we had to send again
+    uint32_t link_duplicates;     // Duplicate or stale reliable packets we dropped
+    uint32_t link_lost;           // Reliable packets given up on or evicted from a full window
+    uint32_t link_rx_errors;      // COBS frames that failed to decode or had a bad CRC
+    uint32_t link_checksum_errors; // Legacy frames with a bad checksum
+    uint32_t link_discarded;      // Bytes skipped while looking for the start of a frame
+    uint32_t link_unknown_types;  // Intact frames of a message type we don't know
+    uint32_t link_overruns;       // Times the DMA wrote over RX bytes we hadn't read yet
+    uint32_t link_baudrate;       // Current UART baud rate
+    volatile uint32_t link_baud_request; // Rate for core0 to switch to once TX is idle, 0 if none
+    link_speed_t link_speed;      // Baud rate training
+    link_clock_t link_clock;      // Round trip time and clock offset to the other board
 
     /* Firmware */
     fw_upgrade_state_t fw;           // State of the firmware upgrader
@@ -26,9 +26,13 @@ void heartbeat_output_task(device_t *);
 void kick_watchdog_task(device_t *);
 void led_blinking_task(device_t *);
 void packet_receiver_task(device_t *);
-void process_hid_queue_task(device_t *);
-void process_kbd_queue_task(device_t *);
-void process_mouse_queue_task(device_t *);
+void process_mouse_link_task(device_t *);
+void process_outbound_task(device_t *);
+void process_set_report_task(device_t *);
+void resend_values_task(device_t *);
+void link_speed_task(device_t *);
+void kbd_sync_task(device_t *);
 void process_uart_tx_task(device_t *);
+void stats_task(device_t *);
 void usb_device_task(device_t *);
 void usb_host_task(device_t *);
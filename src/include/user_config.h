@@ -45,6 +45,10 @@
  * HID_KEY_F24 is probably a good choice as keyboards with 24 function keys
  * are rare.
  *
+ * These are only the defaults. Hotkeys live in a table in the config (up to
+ * HOTKEY_COUNT entries, each a modifier plus up to HOTKEY_MAX_KEYS keys) and
+ * can be changed over the config API without reflashing.
+ *
  * */
 
 #define HOTKEY_MODIFIER    0
@@ -60,6 +64,9 @@
  * MOUSE_SPEED_A_FACTOR_X: [1-128], mouse moves at this speed in X direction
  * MOUSE_SPEED_A_FACTOR_Y: [1-128], mouse moves at this speed in Y direction
  *
+ * The factor is in 1/16 steps, 16 moves the cursor exactly as the mouse reports it,
+ * 8 at half and 32 at double the speed.
+ *
  * JUMP_THRESHOLD: [0-32768], sets the "force" you need to use to drag the
  * mouse to another screen, 0 meaning no force needed at all, and ~500 some force
  * needed, ~1000 no accidental jumps, you need to really mean it.
@@ -70,13 +77,15 @@
  *
  * */
 
-/* Output A values, default is for the most common ~ 16:9 ratio screen */
+/* Output A values, default is native mouse speed */
 #define MOUSE_SPEED_A_FACTOR_X 16
-#define MOUSE_SPEED_A_FACTOR_Y 28
+#define MOUSE_SPEED_A_FACTOR_Y 16
 
-/* Output B values, default is for the most common ~ 16:9 ratio screen */
+/* Output B values, default is native mouse speed */
 #define MOUSE_SPEED_B_FACTOR_X 16
-#define MOUSE_SPEED_B_FACTOR_Y 28
+#define MOUSE_SPEED_B_FACTOR_Y 16
+
+#define ENABLE_ACCELERATION 0
 
 
 
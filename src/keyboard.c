@@ -29,14 +29,91 @@ bool key_in_report(uint8_t key, const hid_keyboard_report_t *report) {
     return false;
 }
 
-/* Check if F17 key is pressed for output switching */
-bool check_f17_hotkey(const hid_keyboard_report_t *report) {
-    return key_in_report(HOTKEY_TOGGLE, report);
+/* ============================================================ *
+ * Hotkey table matching
+ * ============================================================ */
+
+static const action_handler_t hotkey_handlers[] = {
+    [HOTKEY_ACTION_OUTPUT_TOGGLE] = output_toggle_hotkey_handler,
+    [HOTKEY_ACTION_NULL_MODE]     = null_mode_toggle_hotkey_handler,
+};
+
+/* Nibble-wise AND of the four bits, leaves bit 0 of each nibble set when all slots are satisfied */
+#define NIBBLES_COMPLETE(x) ((x) & ((x) >> 1) & ((x) >> 2) & ((x) >> 3) & 0x11111111u)
+
+/* Translate the hotkey table from config into lookup masks. Runs on config load and
+   whenever a hotkey is changed over the API, so matching never touches the table. */
+void compile_hotkeys(device_t *state) {
+    hotkey_matcher_t *matcher = &state->hotkeys;
+    uint32_t active[MAX_DEVICES];
+
+    memcpy(active, matcher->active, sizeof(active));
+    memset(matcher, 0, sizeof(hotkey_matcher_t));
+
+    /* Combos held while the table changes stay held, so they don't fire again on the next report */
+    memcpy(matcher->active, active, sizeof(active));
+
+    for (int i = 0; i < HOTKEY_COUNT; i++) {
+        const hotkey_combo_t *hotkey = &state->config.hotkeys[i];
+        uint32_t nibble_bit = 1u << (i * 4);
+        bool has_keys = false;
+
+        /* Unknown actions are treated as disabled entries */
+        if (hotkey->action >= ARRAY_SIZE(hotkey_handlers) || hotkey_handlers[hotkey->action] == NULL)
+            continue;
+
+        for (int j = 0; j < HOTKEY_MAX_KEYS; j++) {
+            uint32_t slot_bit = nibble_bit << (j + 1);
+
+            if (hotkey->keys[j] == HID_KEY_NONE) {
+                matcher->unused_bits |= slot_bit;
+                continue;
+            }
+
+            matcher->key_bits[hotkey->keys[j]] |= slot_bit;
+            has_keys = true;
+        }
+
+        /* A hotkey needs at least something to be pressed, otherwise it would fire constantly */
+        if (!has_keys && hotkey->modifier == 0) {
+            matcher->unused_bits &= ~(0xFu << (i * 4));
+            continue;
+        }
+
+        for (int mod = 0; mod < 256; mod++)
+            if ((mod & hotkey->modifier) == hotkey->modifier)
+                matcher->modifier_bits[mod] |= nibble_bit;
+
+        if (!hotkey->pass_to_os)
+            matcher->block_mask |= nibble_bit;
+    }
 }
 
-/* Check if HELP key is pressed for NULL MODE toggle */
-bool check_null_mode_hotkey(const hid_keyboard_report_t *report) {
-    return key_in_report(HOTKEY_NULL_MODE, report);
+/* Match the report against all hotkeys at once and execute the newly pressed ones. Each
+   keyboard is tracked on its own, so a report from another one can't retrigger a combo
+   that is still held. Returns true if the report contains a hotkey that is not to be
+   passed to the OS. */
+bool check_hotkeys(device_t *state, hid_keyboard_report_t *report, uint8_t device_idx) {
+    hotkey_matcher_t *matcher = &state->hotkeys;
+    uint32_t *active          = &matcher->active[device_idx < MAX_DEVICES ? device_idx : MAX_DEVICES - 1];
+    uint32_t seen = matcher->modifier_bits[report->modifier] | matcher->unused_bits;
+
+    for (int i = 0; i < KEYS_IN_USB_REPORT; i++)
+        seen |= matcher->key_bits[report->keycode[i]];
+
+    uint32_t matched = NIBBLES_COMPLETE(seen);
+
+    /* Only act on the transition to pressed, holding the combo doesn't repeat the action */
+    uint32_t triggered = matched & ~*active;
+    *active            = matched;
+
+    while (triggered) {
+        int idx = __builtin_ctz(triggered) / 4;
+        hotkey_handlers[state->config.hotkeys[idx].action](state, report);
+        triggered &= triggered - 1;
+    }
+
+    return (matched & matcher->block_mask) != 0;
 }
 
 /* ==================================================== *
@@ -80,6 +157,9 @@ static void add_keys(hid_keyboard_report_t *dest, const hid_keyboard_report_t *s
 void release_all_keys(device_t *state) {
     memset(state->local_kbd_states, 0, sizeof(state->local_kbd_states));
     memset(&state->remote_kbd_state, 0, sizeof(hid_keyboard_report_t));
+
+    /* Other board releases everything on an output switch too, so both sides stay in sync */
+    memset(&state->kbd_sync_tx.sent, 0, sizeof(hid_keyboard_report_t));
     
     /* Don't send empty report if NULL MODE is active */
     if (state->null_mode)
@@ -106,38 +186,159 @@ void combine_kbd_states(device_t *state, hid_keyboard_report_t *combined_report)
 }
 
 /* ==================================================== *
- * Keyboard Queue Section
- * ==================================================== */
+ * Keyboard State Sync
+ * ==================================================== *
+ *
+ * When the keyboard is typing on the other board's computer, we replicate its state there.
+ * Each change goes out as a small delta - the new modifier byte and the keys that went down
+ * or up - stamped with a version. If the other board sees a version gap, a delta got lost,
+ * and it asks for a snapshot of the full state. Snapshots also go out periodically and
+ * whenever the last key is released, so a lost delta never leaves a key stuck for long.
+ */
 
-void process_kbd_queue_task(device_t *state) {
-    hid_keyboard_report_t report;
+static bool report_is_empty(const hid_keyboard_report_t *report) {
+    static const hid_keyboard_report_t empty_report = {0};
+    return memcmp(report, &empty_report, sizeof(hid_keyboard_report_t)) == 0;
+}
 
-    /* If NULL MODE is active, don't send any keyboard reports */
-    if (state->null_mode)
-        return;
+/* Press keys not in the report, release the ones that are */
+static void toggle_key(hid_keyboard_report_t *report, uint8_t key) {
+    uint8_t *slot = memchr(report->keycode, key, KEYS_IN_USB_REPORT);
 
-    /* If we're not connected, we have nowhere to send reports to. */
-    if (!state->tud_connected)
+    if (slot == NULL)
+        slot = memchr(report->keycode, 0, KEYS_IN_USB_REPORT);
+    else
+        key = 0;
+
+    if (slot)
+        *slot = key;
+}
+
+void send_kbd_snapshot(device_t *state) {
+    kbd_sync_tx_t *tx = &state->kbd_sync_tx;
+    uint8_t data[PACKET_DATA_LENGTH] = {
+        [KBD_SYNC_VERSION_IDX]  = tx->version,
+        [KBD_SYNC_MODIFIER_IDX] = tx->sent.modifier,
+    };
+
+    memcpy(&data[KBD_SYNC_KEYS_IDX], tx->sent.keycode, KBD_SYNC_MAX_KEYS);
+    queue_packet(data, KBD_SNAPSHOT_MSG, PACKET_DATA_LENGTH);
+}
+
+static void send_kbd_delta(hid_keyboard_report_t *report, device_t *state) {
+    kbd_sync_tx_t *tx = &state->kbd_sync_tx;
+    uint8_t toggled[2 * KEYS_IN_USB_REPORT];
+    int count = 0;
+
+    /* Keys that went up, then keys that went down */
+    for (int i = 0; i < KEYS_IN_USB_REPORT; i++)
+        if (tx->sent.keycode[i] && !key_in_report(tx->sent.keycode[i], report))
+            toggled[count++] = tx->sent.keycode[i];
+
+    for (int i = 0; i < KEYS_IN_USB_REPORT; i++)
+        if (report->keycode[i] && !key_in_report(report->keycode[i], &tx->sent))
+            toggled[count++] = report->keycode[i];
+
+    if (count == 0 && report->modifier == tx->sent.modifier)
         return;
 
-    /* Peek first, if there is anything there... */
-    if (!queue_try_peek(&state->kbd_queue, &report))
+    tx->version++;
+    tx->sent = *report;
+
+    /* Too many changes at once to fit in a delta */
+    if (count > KBD_SYNC_MAX_KEYS) {
+        send_kbd_snapshot(state);
         return;
+    }
+
+    uint8_t data[PACKET_DATA_LENGTH] = {
+        [KBD_SYNC_VERSION_IDX]  = tx->version,
+        [KBD_SYNC_MODIFIER_IDX] = report->modifier,
+    };
+
+    memcpy(&data[KBD_SYNC_KEYS_IDX], toggled, count);
+    queue_packet(data, KBD_DELTA_MSG, PACKET_DATA_LENGTH);
+
+    /* Losing the final release would leave a key stuck, so confirm the idle state right away */
+    if (report_is_empty(report))
+        send_kbd_snapshot(state);
+}
+
+/* Delta from the other board, returns true if our copy of its state changed */
+bool apply_kbd_delta(uint8_t *data, device_t *state) {
+    kbd_sync_rx_t *rx = &state->kbd_sync_rx;
+    uint8_t version   = data[KBD_SYNC_VERSION_IDX];
+
+    /* Missed something, keep what we have until a snapshot brings us back */
+    if (!rx->synced || version != (uint8_t)(rx->version + 1)) {
+        if (rx->synced)
+            rx->gaps++;
+
+        rx->synced = false;
+
+        if (time_us_32() - rx->requested >= KBD_SYNC_REQUEST_US) {
+            rx->requested = time_us_32();
+            send_value(0, KBD_SYNC_REQUEST_MSG);
+        }
+        return false;
+    }
+
+    rx->version = version;
+    state->remote_kbd_state.modifier = data[KBD_SYNC_MODIFIER_IDX];
 
-    /* If we are suspended, let's wake the host up */
-    if (tud_suspended())
-        tud_remote_wakeup();
+    for (int i = 0; i < KBD_SYNC_MAX_KEYS && data[KBD_SYNC_KEYS_IDX + i]; i++)
+        toggle_key(&state->remote_kbd_state, data[KBD_SYNC_KEYS_IDX + i]);
+
+    return true;
+}
 
-    /* If it's not ok to send yet, we'll try on the next pass */
-    if (!tud_hid_n_ready(ITF_NUM_HID))
+/* Snapshot from the other board, returns true if our copy of its state changed */
+bool apply_kbd_snapshot(uint8_t *data, device_t *state) {
+    kbd_sync_rx_t *rx = &state->kbd_sync_rx;
+    hid_keyboard_report_t report = {.modifier = data[KBD_SYNC_MODIFIER_IDX]};
+
+    memcpy(report.keycode, &data[KBD_SYNC_KEYS_IDX], KBD_SYNC_MAX_KEYS);
+
+    rx->version = data[KBD_SYNC_VERSION_IDX];
+    rx->synced  = true;
+
+    if (memcmp(&report, &state->remote_kbd_state, sizeof(hid_keyboard_report_t)) == 0)
+        return false;
+
+    update_remote_kbd_state(state, &report);
+    return true;
+}
+
+/* Periodic snapshot, heals whatever loss the version check couldn't see */
+void kbd_sync_task(device_t *state) {
+    if (!(state->link_flags & LINK_FLAG_KBD_SYNC) || CURRENT_BOARD_IS_ACTIVE_OUTPUT)
         return;
 
+    send_kbd_snapshot(state);
+}
+
+/* ==================================================== *
+ * Keyboard Queue Section
+ * ==================================================== */
+
+/* Send the oldest queued keyboard report, called by the outbound scheduler once the
+   endpoint is ready. Returns true if the report was handed over to the host. */
+bool send_queued_kbd_report(device_t *state) {
+    hid_keyboard_report_t *report = ring_front(&state->kbd_queue);
+
+    if (report == NULL)
+        return false;
+
     /* ... try sending it to the host, if it's successful */
-    bool succeeded = tud_hid_keyboard_report(REPORT_ID_KEYBOARD, report.modifier, report.keycode);
+    bool succeeded = tud_hid_keyboard_report(REPORT_ID_KEYBOARD, report->modifier, report->keycode);
 
     /* ... then we can remove it from the queue. Race conditions shouldn't happen [tm] */
     if (succeeded)
-        queue_try_remove(&state->kbd_queue, &report);
+        ring_release(&state->kbd_queue);
+    else
+        ring_keep(&state->kbd_queue);
+
+    return succeeded;
 }
 
 void queue_kbd_report(hid_keyboard_report_t *report, device_t *state) {
@@ -145,7 +346,7 @@ void queue_kbd_report(hid_keyboard_report_t *report, device_t *state) {
     if (!state->tud_connected)
         return;
 
-    queue_try_add(&state->kbd_queue, report);
+    ring_try_add(&state->kbd_queue, report);
 }
 
 /* If keys need to go locally, queue packet to kbd queue, else send them through UART */
@@ -158,6 +359,9 @@ void send_key(hid_keyboard_report_t *report, device_t *state) {
         /* Queue the combined report */
         queue_kbd_report(&combined_report, state);
         state->last_activity[BOARD_ROLE] = time_us_64();
+    } else if (state->link_flags & LINK_FLAG_KBD_SYNC) {
+        /* Other board keeps a replica of our state, just tell it what changed */
+        send_kbd_delta(&combined_report, state);
     } else {
         /* Send the combined report to ensure all keys are included */
         queue_packet((uint8_t *)&combined_report, KEYBOARD_REPORT_MSG, KBD_REPORT_LENGTH);
@@ -204,19 +408,9 @@ void process_keyboard_report(uint8_t *raw_report, int length, uint8_t itf, hid_i
     /* Update the keyboard state for this device */
     update_kbd_state(state, &new_report, itf);
 
-    /* Check if F17 hotkey was pressed for output switching */
-    if (check_f17_hotkey(&new_report)) {
-        /* Execute the output toggle handler and don't pass key to OS */
-        output_toggle_hotkey_handler(state, &new_report);
+    /* Check if any of the hotkeys was pressed, if so don't pass the key to OS */
+    if (check_hotkeys(state, &new_report, itf))
         return;
-    }
-
-    /* Check if HELP hotkey was pressed for NULL MODE toggle */
-    if (check_null_mode_hotkey(&new_report)) {
-        /* Execute the NULL MODE toggle handler and don't pass key to OS */
-        null_mode_toggle_hotkey_handler(state, &new_report);
-        return;
-    }
 
     /* If NULL MODE is active, drop all keyboard input */
     if (state->null_mode) {
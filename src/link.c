@@ -0,0 +1,520 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+
+#include "main.h"
+
+/* ================================================== *
+ * ===============  CRC-16 and COBS  ================ *
+ * ================================================== */
+
+/* CRC-16/CCITT-FALSE, catches all double-bit errors and byte swaps the XOR sum misses */
+uint16_t crc16(const uint8_t *data, int length) {
+    uint16_t crc = 0xFFFF;
+
+    for (int i = 0; i < length; i++)
+        crc = (crc << 8) ^ crc16_lookup_table[(crc >> 8) ^ data[i]];
+
+    return crc;
+}
+
+/* Consistent overhead byte stuffing, output contains no zeros and is at most one byte
+   longer than the input (for inputs under 254 bytes). Returns the encoded length. */
+int cobs_encode(const uint8_t *src, int length, uint8_t *dst) {
+    int code_idx = 0, out = 1;
+    uint8_t code = 1;
+
+    for (int i = 0; i < length; i++) {
+        if (src[i] != 0) {
+            dst[out++] = src[i];
+            code++;
+        }
+
+        if (src[i] == 0 || code == 0xFF) {
+            dst[code_idx] = code;
+            code_idx      = out++;
+            code          = 1;
+        }
+    }
+
+    dst[code_idx] = code;
+    return out;
+}
+
+/* Returns the decoded length, or -1 if the input is malformed or doesn't fit */
+int cobs_decode(const uint8_t *src, int length, uint8_t *dst, int max_length) {
+    int out = 0;
+
+    for (int i = 0; i < length;) {
+        uint8_t code = src[i++];
+
+        if (code == 0 || i + code - 1 > length || out + code - 1 > max_length)
+            return -1;
+
+        for (int j = 1; j < code; j++)
+            dst[out++] = src[i++];
+
+        /* Every block except a full one and the last one ends with an implied zero */
+        if (code != 0xFF && i < length) {
+            if (out >= max_length)
+                return -1;
+            dst[out++] = 0;
+        }
+    }
+
+    return out;
+}
+
+/* ================================================== *
+ * ================  Sending Frames  ================ *
+ * ================================================== */
+
+static int encode_cobs_packet(uint8_t *dst, uart_packet_t *packet, bool reliable, uint16_t seq) {
+    uint8_t raw[COBS_MAX_PAYLOAD];
+    int len = PACKET_DATA_LENGTH, header = TYPE_LENGTH;
+
+    /* Trailing zeros are implied, the receiver fills them back in */
+    while (len > 0 && packet->data[len - 1] == 0)
+        len--;
+
+    raw[0] = packet->type;
+
+    if (reliable) {
+        raw[0] |= LINK_RELIABLE_BIT;
+        raw[header++] = seq & 0xFF;
+        raw[header++] = seq >> 8;
+    }
+
+    memcpy(&raw[header], packet->data, len);
+    len += header;
+
+    uint16_t crc = crc16(raw, len);
+    raw[len++]   = crc & 0xFF;
+    raw[len++]   = crc >> 8;
+
+    int frame_len = cobs_encode(raw, len, dst);
+    dst[frame_len++] = COBS_DELIMITER;
+
+    return frame_len;
+}
+
+/* Messages that change state on the other board, a lost one would leave the boards out of
+   sync until the next change. Each one carries the complete state for its type, so a newer
+   packet supersedes an older one of the same type. Motion stays fire-and-forget. */
+static bool is_reliable_type(uint8_t type) {
+    const message_t *message = get_message(type);
+    return message != NULL && message->reliable;
+}
+
+static bool link_is_reliable(device_t *state) {
+    return (state->link_flags & (LINK_FLAG_COBS | LINK_FLAG_RELIABLE))
+           == (LINK_FLAG_COBS | LINK_FLAG_RELIABLE);
+}
+
+/* Find a window slot for a new reliable packet. A packet of the same type still waiting
+   is superseded, otherwise use a free slot, or as a last resort evict the oldest one. */
+static link_tx_slot_t *claim_link_slot(uint8_t type, device_t *state) {
+    link_tx_slot_t *free_slot = NULL, *oldest = NULL;
+
+    for (int i = 0; i < LINK_TX_WINDOW; i++) {
+        link_tx_slot_t *slot = &state->link_tx_window[i];
+
+        if (!slot->in_use) {
+            free_slot = slot;
+            continue;
+        }
+
+        if (slot->packet.type == type)
+            return slot;
+
+        if (oldest == NULL || (int16_t)(slot->seq - oldest->seq) < 0)
+            oldest = slot;
+    }
+
+    if (free_slot)
+        return free_slot;
+
+    state->link_lost++;
+    return oldest;
+}
+
+/* Ping and pong times are taken as the frame is packed for DMA, not when it was queued, so
+   time spent waiting in a TX lane doesn't count as link delay */
+static void stamp_link_clock(uart_packet_t *packet, device_t *state) {
+    uint32_t now = time_us_32();
+
+    if (packet->type == HEARTBEAT_MSG) {
+        packet->data16[LINK_PING_TOKEN_IDX] = (uint16_t)now;
+        state->link_clock.ping_sent         = now;
+    } else if (packet->type == LINK_PONG_MSG) {
+        uint32_t hold = now - packet->data32[LINK_PONG_RECV_IDX];
+        packet->data16[LINK_PONG_HOLD_IDX] = hold > UINT16_MAX ? UINT16_MAX : hold;
+    }
+}
+
+/* Frame the packet in whatever format the other board understands, returns the length */
+int write_link_frame(uint8_t *dst, uart_packet_t *packet, device_t *state) {
+    stamp_link_clock(packet, state);
+
+    if (link_is_reliable(state) && is_reliable_type(packet->type)) {
+        link_tx_slot_t *slot = claim_link_slot(packet->type, state);
+
+        slot->packet  = *packet;
+        slot->seq     = state->link_tx_seq++;
+        slot->retries = 0;
+        slot->in_use  = true;
+        slot->sent_us = time_us_32();
+
+        return encode_cobs_packet(dst, packet, true, slot->seq);
+    }
+
+    if (state->link_flags & LINK_FLAG_COBS)
+        return encode_cobs_packet(dst, packet, false, 0);
+
+    write_raw_packet(dst, packet);
+    return RAW_PACKET_LENGTH;
+}
+
+/* ================================================== *
+ * ===============  Receiving Frames  =============== *
+ * ================================================== */
+
+static bool decode_cobs_packet(const uint8_t *frame, int frame_len, device_t *state) {
+    uart_packet_t *packet = &state->in_packet;
+    uint8_t raw[COBS_MAX_PAYLOAD];
+    int len    = cobs_decode(frame, frame_len, raw, sizeof(raw));
+    int header = TYPE_LENGTH;
+
+    if (len < TYPE_LENGTH + COBS_CRC_LENGTH)
+        return false;
+
+    len -= COBS_CRC_LENGTH;
+
+    if (crc16(raw, len) != (raw[len] | raw[len + 1] << 8))
+        return false;
+
+    state->in_reliable = raw[0] & LINK_RELIABLE_BIT;
+
+    if (state->in_reliable) {
+        if (len < TYPE_LENGTH + LINK_SEQ_LENGTH)
+            return false;
+
+        state->in_seq = raw[1] | raw[2] << 8;
+        header += LINK_SEQ_LENGTH;
+    }
+
+    /* Frames are trimmed to what the sender had, more than the longest payload means garbage */
+    const message_t *message = get_message(raw[0] & ~LINK_RELIABLE_BIT);
+    uint8_t max_length       = message ? message->length : PACKET_DATA_LENGTH;
+
+    if (len - header > max_length)
+        return false;
+
+    memset(packet, 0, sizeof(uart_packet_t));
+    packet->type = raw[0] & ~LINK_RELIABLE_BIT;
+    memcpy(packet->data, &raw[header], len - header);
+
+    /* CRC was checked already, but the rest of the pipeline expects the legacy checksum */
+    packet->checksum = calc_checksum(packet->data, PACKET_DATA_LENGTH);
+    return true;
+}
+
+/* Length of the frame at the RX position up to its delimiter, -1 if there's none in span */
+static int find_cobs_delimiter(uint32_t idx, uint32_t span) {
+    uint32_t contiguous = DMA_RX_BUFFER_SIZE - idx;
+    uint8_t *delimiter  = memchr(&uart_rxbuf[idx], COBS_DELIMITER, MIN(span, contiguous));
+
+    if (delimiter)
+        return delimiter - &uart_rxbuf[idx];
+
+    if (span <= contiguous)
+        return -1;
+
+    delimiter = memchr(uart_rxbuf, COBS_DELIMITER, span - contiguous);
+    return delimiter ? contiguous + (delimiter - uart_rxbuf) : -1;
+}
+
+/* Tries to read a COBS frame at the current RX position, with available bytes received.
+   Returns the number of bytes to consume, 0 if the frame isn't complete yet. On success,
+   state->in_packet holds the packet and valid is set. */
+uint32_t fetch_cobs_packet(device_t *state, uint32_t available, bool *valid) {
+    uint8_t frame[COBS_MAX_FRAME];
+    uint32_t idx = state->dma_ptr;
+    int len      = find_cobs_delimiter(idx, MIN(available, COBS_MAX_FRAME));
+
+    *valid = false;
+
+    /* No delimiter yet, wait for the rest unless it's already too long to be one of ours */
+    if (len < 0)
+        return (available >= COBS_MAX_FRAME) ? find_frame_start(state, available) : 0;
+
+    /* Decode straight from the ring, only a frame wrapping around its end gets copied */
+    if (idx + len <= DMA_RX_BUFFER_SIZE) {
+        *valid = decode_cobs_packet(&uart_rxbuf[idx], len, state);
+    } else {
+        copy_from_rx_ring(frame, idx, len);
+        *valid = decode_cobs_packet(frame, len, state);
+    }
+
+    if (*valid)
+        return len + 1;
+
+    if (len > 0)
+        state->link_rx_errors++;
+
+    /* Resync at the next preamble or delimiter, a legacy frame might start inside the garbage */
+    return find_frame_start(state, available);
+}
+
+/* ================================================== *
+ * ===============  Reliable Delivery  ============== *
+ * ================================================== *
+ *
+ * Reliable packets carry a sequence number, the receiver answers each one with an ACK and
+ * the sender keeps it in a small window, resending it until acknowledged. Every reliable
+ * packet is acknowledged on its own, so only the lost ones are sent again. Receiving is
+ * done on core1, sending on core0, ACKs are passed between them through link_ack_queue.
+ */
+
+/* Called on core1 for every valid packet received, returns false if it shouldn't be processed */
+bool accept_link_packet(device_t *state) {
+    uart_packet_t *packet = &state->in_packet;
+    uint32_t now          = time_us_32();
+
+    if (packet->type == LINK_ACK_MSG) {
+        ring_try_add(&state->link_ack_queue, &packet->data16[0]);
+        return false;
+    }
+
+    if (!state->in_reliable)
+        return true;
+
+    /* Always acknowledge, even duplicates - our previous ACK might have been lost */
+    queue_packet((uint8_t *)&state->in_seq, LINK_ACK_MSG, LINK_SEQ_LENGTH);
+
+    if (packet->type >= LINK_RX_TYPES)
+        return true;
+
+    /* A retransmission we already have, or an older packet a newer one superseded.
+       Sequence numbers are only compared for a while, so wraparound can't block a type. */
+    link_rx_t *rx = &state->link_rx[packet->type];
+
+    if (rx->seen && now - rx->when < LINK_STALE_US && (int16_t)(state->in_seq - rx->seq) <= 0) {
+        state->link_duplicates++;
+        return false;
+    }
+
+    rx->seq  = state->in_seq;
+    rx->seen = true;
+    rx->when = now;
+
+    return true;
+}
+
+/* Called on core0, frees the window slots the other board acknowledged */
+void process_link_acks(device_t *state) {
+    uint16_t seq;
+
+    while (ring_try_remove(&state->link_ack_queue, &seq))
+        for (int i = 0; i < LINK_TX_WINDOW; i++)
+            if (state->link_tx_window[i].in_use && state->link_tx_window[i].seq == seq)
+                state->link_tx_window[i].in_use = false;
+}
+
+/* Called on core0 before new packets are framed, resends the packets whose ACK is overdue.
+   Returns the number of bytes written, at most max_length. */
+int retransmit_link_packets(device_t *state, uint8_t *dst, int max_length) {
+    uint32_t now = time_us_32();
+    int len      = 0;
+
+    for (int i = 0; i < LINK_TX_WINDOW; i++) {
+        link_tx_slot_t *slot = &state->link_tx_window[i];
+
+        if (!slot->in_use || now - slot->sent_us < LINK_RETRANSMIT_US)
+            continue;
+
+        /* Other board went away or doesn't do ACKs anymore, nobody is going to answer */
+        if (!link_is_reliable(state) || slot->retries >= LINK_MAX_RETRIES) {
+            slot->in_use = false;
+            state->link_lost++;
+            continue;
+        }
+
+        if (len + LINK_MAX_FRAME > max_length)
+            break;
+
+        len += encode_cobs_packet(&dst[len], &slot->packet, true, slot->seq);
+        slot->sent_us = now;
+        slot->retries++;
+        state->link_retransmits++;
+    }
+
+    return len;
+}
+
+/* ================================================== *
+ * ===============  Link Negotiation  =============== *
+ * ================================================== *
+ *
+ * Each board sends LINK_CAPS_MSG along with its heartbeat, and uses a feature only when
+ * both boards advertise it. Both boards always accept every kind of frame, so until the
+ * caps arrive, and with older firmware that never sends them, we stay on the original
+ * fire-and-forget 12-byte frames. New features get a new bit and roll out board by board.
+ */
+
+void reset_link_caps(device_t *state) {
+    state->link_flags       = 0;
+    state->link_baud_mask   = 1 << LINK_BAUDRATE_DEFAULT_IDX;
+    state->link_max_payload = PACKET_DATA_LENGTH;
+    state->link_peer_caps   = 0;
+    state->link_caps_age    = 0;
+}
+
+void send_link_caps(device_t *state) {
+    uart_packet_t caps = {
+        .data = {
+            [LINK_CAPS_VERSION_IDX] = LINK_CAPS_VERSION,
+            [LINK_CAPS_PAYLOAD_IDX] = PACKET_DATA_LENGTH,
+            [LINK_CAPS_BAUD_IDX]    = LINK_BAUDRATES_SUPPORTED,
+        },
+    };
+
+    caps.data32[LINK_CAPS_FEATURES_IDX] = LINK_FLAGS_SUPPORTED;
+    queue_packet(caps.data, LINK_CAPS_MSG, PACKET_DATA_LENGTH);
+}
+
+/* Enable what both of us support */
+void update_link_caps(uart_packet_t *packet, device_t *state) {
+    uint8_t version = packet->data[LINK_CAPS_VERSION_IDX];
+    uint8_t payload = packet->data[LINK_CAPS_PAYLOAD_IDX];
+
+    if (version == 0)
+        return;
+
+    state->link_flags       = packet->data32[LINK_CAPS_FEATURES_IDX] & LINK_FLAGS_SUPPORTED;
+    state->link_baud_mask   = packet->data[LINK_CAPS_BAUD_IDX] & LINK_BAUDRATES_SUPPORTED;
+    state->link_max_payload = payload < PACKET_DATA_LENGTH ? payload : PACKET_DATA_LENGTH;
+    state->link_peer_caps   = version;
+    state->link_caps_age    = 0;
+}
+
+/* Called for every heartbeat, the caps follow right after it. If the firmware version changes
+   or the caps stop coming, the other board rebooted, maybe into older firmware that can't
+   parse what we negotiated. The timeout in check_link_peer() won't catch that, since its
+   heartbeats keep arriving. */
+void update_link_peer(uart_packet_t *packet, device_t *state) {
+    uint16_t version = packet->data16[LINK_PEER_VERSION_IDX];
+    bool negotiated  = state->link_peer_caps != 0;
+    bool rebooted    = version != state->link_peer_version;
+    bool stale       = negotiated && ++state->link_caps_age > LINK_CAPS_MAX_AGE;
+
+    state->link_peer_seen    = time_us_32();
+    state->link_peer_version = version;
+
+    if (negotiated && (rebooted || stale)) {
+        reset_link_caps(state);
+        reset_link_speed(state);
+    }
+}
+
+/* Called periodically, if the other board went quiet it may come back with older firmware */
+void check_link_peer(device_t *state) {
+    if (time_us_32() - state->link_peer_seen > LINK_PEER_TIMEOUT_US) {
+        reset_link_caps(state);
+        reset_link_speed(state);
+    }
+}
+
+/* ================================================== *
+ * ==================  Link Clock  ================== *
+ * ================================================== *
+ *
+ * NTP-style: we send the ping at t1, the other board gets it at t2 and answers at t3,
+ * the pong arrives at t4. RTT is (t4 - t1) - (t3 - t2), and the offset between the clocks
+ * is ((t2 - t1) + (t3 - t4)) / 2. Queueing delays make single samples noisy, but the
+ * sample with the lowest RTT waited the least, so its offset is the one we trust.
+ *
+ * Timestamps are 32-bit on the wire, so the offset assumes the boards booted within
+ * 35 minutes of each other - they normally share a power supply.
+ */
+
+/* Called from the heartbeat handler, the heartbeat is the ping. How long we held it is
+   filled in once the pong is packed for sending, see stamp_link_clock(). */
+void answer_link_ping(uart_packet_t *packet, device_t *state) {
+    uart_packet_t pong = {.type = LINK_PONG_MSG};
+
+    /* Older firmware doesn't know what to do with a pong */
+    if (!(state->link_flags & LINK_FLAG_CLOCK))
+        return;
+
+    pong.data32[LINK_PONG_RECV_IDX]  = time_us_32();
+    pong.data16[LINK_PONG_TOKEN_IDX] = packet->data16[LINK_PING_TOKEN_IDX];
+
+    queue_packet(pong.data, LINK_PONG_MSG, PACKET_DATA_LENGTH);
+}
+
+/* Smoothed RTT and deviation like TCP does it, flagging rounds far above the norm */
+static void track_rtt(link_clock_t *clock, uint32_t rtt) {
+    if (clock->sample_count > 1 && rtt > clock->srtt_us + LINK_RTT_SPIKE_FACTOR * clock->rttvar_us)
+        clock->rtt_spikes++;
+
+    if (clock->sample_count == 1) {
+        clock->srtt_us   = rtt;
+        clock->rttvar_us = rtt / 2;
+    } else {
+        uint32_t deviation = rtt > clock->srtt_us ? rtt - clock->srtt_us : clock->srtt_us - rtt;
+        clock->rttvar_us   = (3 * clock->rttvar_us + deviation) / 4;
+        clock->srtt_us     = (7 * clock->srtt_us + rtt) / 8;
+    }
+
+    if (rtt > clock->rtt_max_us)
+        clock->rtt_max_us = rtt;
+}
+
+/* Called when the pong to our heartbeat arrives */
+void update_link_clock(uart_packet_t *packet, device_t *state) {
+    link_clock_t *clock = &state->link_clock;
+    uint32_t t4         = time_us_32();
+    uint32_t t1         = clock->ping_sent;
+    uint32_t t2         = packet->data32[LINK_PONG_RECV_IDX];
+    uint32_t t3         = t2 + packet->data16[LINK_PONG_HOLD_IDX];
+
+    /* Not an answer to our latest ping */
+    if (!clock->ping_pending || packet->data16[LINK_PONG_TOKEN_IDX] != (uint16_t)t1)
+        return;
+
+    clock->ping_pending = false;
+
+    link_clock_sample_t *sample = &clock->samples[clock->sample_idx];
+    sample->rtt_us    = (t4 - t1) - (t3 - t2);
+    sample->offset_us = ((int64_t)(int32_t)(t2 - t1) + (int32_t)(t3 - t4)) / 2;
+
+    clock->sample_idx = (clock->sample_idx + 1) % LINK_CLOCK_SAMPLES;
+
+    if (clock->sample_count < LINK_CLOCK_SAMPLES)
+        clock->sample_count++;
+
+    track_rtt(clock, sample->rtt_us);
+
+    /* Least delayed sample in the window wins */
+    link_clock_sample_t *best = &clock->samples[0];
+
+    for (int i = 1; i < clock->sample_count; i++)
+        if (clock->samples[i].rtt_us < best->rtt_us)
+            best = &clock->samples[i];
+
+    clock->rtt_us    = best->rtt_us;
+    clock->offset_us = best->offset_us;
+}
+
+/* Convert a time_us_64 timestamp taken on the other board to our own clock */
+uint64_t peer_to_local_us(uint64_t peer_us, device_t *state) {
+    return peer_us - (int64_t)state->link_clock.offset_us;
+}
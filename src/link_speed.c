@@ -0,0 +1,385 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+
+#include "main.h"
+
+/* ================================================== *
+ * ==============  Link Speed Training  ============= *
+ * ================================================== *
+ *
+ * Both boards boot at SERIAL_BAUDRATE. Once board A sees the other board supports it,
+ * it tries faster rates one at a time: it proposes a rate, both boards switch to it
+ * for a few milliseconds while board A sends test patterns, then both switch back and
+ * board B reports how many arrived intact. Every trial ends on the rate that already
+ * worked, so a rate that doesn't work at all costs nothing but a few lost packets.
+ *
+ * When a trial fails, or we run out of rates, we settle one step below the fastest rate
+ * that passed, as a margin for temperature and noise. If errors rise later on, either
+ * board steps down a rate. If the boards ever lose each other, the heartbeat timeout
+ * puts both back to SERIAL_BAUDRATE and training starts over.
+ */
+
+static bool deadline_passed(uint32_t when) {
+    return (int32_t)(time_us_32() - when) >= 0;
+}
+
+/* The switch itself happens on core0, between frames, see switch_link_baudrate(). Every
+   rate change starts the error rate watch over, see check_link_health() */
+static void set_link_baudrate(uint8_t rate_idx, device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+
+    state->link_baud_request = link_baudrates[rate_idx];
+    speed->health_checked = time_us_32();
+    speed->health_errors  = state->link_rx_errors;
+    speed->health_settled = false;
+}
+
+static void send_train_msg(uint8_t op, uint8_t rate_idx, uint8_t result) {
+    uint8_t data[PACKET_DATA_LENGTH] = {
+        [LINK_TRAIN_OP_IDX]     = op,
+        [LINK_TRAIN_RATE_IDX]   = rate_idx,
+        [LINK_TRAIN_RESULT_IDX] = result,
+    };
+
+    queue_packet(data, LINK_TRAIN_MSG, PACKET_DATA_LENGTH);
+}
+
+static void send_train_patterns(uint8_t rate_idx) {
+    uint8_t data[PACKET_DATA_LENGTH] = {
+        [LINK_TRAIN_OP_IDX]   = LINK_TRAIN_PATTERN,
+        [LINK_TRAIN_RATE_IDX] = rate_idx,
+    };
+
+    memcpy(&data[LINK_TRAIN_PATTERN_IDX], link_train_pattern, LINK_TRAIN_PATTERN_LENGTH);
+
+    for (int i = 0; i < LINK_TRAIN_PATTERNS; i++)
+        queue_packet(data, LINK_TRAIN_MSG, PACKET_DATA_LENGTH);
+}
+
+/* Next faster rate both boards can run at and we're allowed to try, LINK_BAUDRATE_COUNT if none */
+static uint8_t faster_rate(uint8_t rate_idx, device_t *state) {
+    while (++rate_idx <= state->link_speed.ceiling_idx)
+        if (state->link_baud_mask & (1 << rate_idx))
+            return rate_idx;
+
+    return LINK_BAUDRATE_COUNT;
+}
+
+/* Next slower rate both boards can run at, or the same one if there is none */
+static uint8_t slower_rate(uint8_t rate_idx, device_t *state) {
+    for (int i = rate_idx - 1; i >= 0; i--)
+        if (state->link_baud_mask & (1 << i))
+            return i;
+
+    return rate_idx;
+}
+
+static void propose_next_rate(device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+
+    send_train_msg(LINK_TRAIN_PROPOSE, speed->trial_idx, 0);
+    speed->phase    = LINK_PHASE_PROPOSED;
+    speed->deadline = time_us_32() + LINK_TRAIN_REPLY_US;
+}
+
+static void send_commit(device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+
+    send_train_msg(LINK_TRAIN_COMMIT, speed->trial_idx, 0);
+    speed->commit_tries++;
+    speed->deadline = time_us_32() + LINK_TRAIN_COMMIT_RETRY_US;
+}
+
+/* Move both boards to a new rate. If we switched on our own and the COMMIT got lost, the
+   boards would end up on different rates, so we only switch once the other board confirms. */
+static void commit_rate(uint8_t rate_idx, device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+
+    speed->phase        = LINK_PHASE_COMMITTING;
+    speed->trial_idx    = rate_idx;
+    speed->commit_tries = 0;
+
+    send_commit(state);
+}
+
+/* Confirm a COMMIT, telling the other board how long until we switch so it can do the same */
+static void send_committed(device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+    int32_t delay       = speed->switch_at - time_us_32();
+
+    uint8_t data[PACKET_DATA_LENGTH] = {
+        [LINK_TRAIN_OP_IDX]   = LINK_TRAIN_COMMITTED,
+        [LINK_TRAIN_RATE_IDX] = speed->trial_idx,
+    };
+
+    if (delay < 0)
+        delay = 0;
+
+    data[LINK_TRAIN_DELAY_IDX]     = delay & 0xFF;
+    data[LINK_TRAIN_DELAY_IDX + 1] = delay >> 8;
+
+    queue_packet(data, LINK_TRAIN_MSG, PACKET_DATA_LENGTH);
+}
+
+static void start_training(device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+
+    speed->initiator = true;
+    speed->trained   = true;
+    speed->best_idx  = speed->rate_idx;
+    speed->trial_idx = faster_rate(speed->rate_idx, state);
+
+    if (speed->trial_idx == LINK_BAUDRATE_COUNT) {
+        speed->phase = LINK_PHASE_IDLE;
+        return;
+    }
+
+    propose_next_rate(state);
+}
+
+/* Initiator got a result, or gave up waiting for one */
+static void finish_trial(bool passed, device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+
+    if (passed) {
+        speed->best_idx  = speed->trial_idx;
+        speed->trial_idx = faster_rate(speed->trial_idx, state);
+
+        if (speed->trial_idx < LINK_BAUDRATE_COUNT) {
+            propose_next_rate(state);
+            return;
+        }
+    }
+
+    /* Keep a step of margin below the fastest rate that passed, but never drop below the
+       rate we started from, we already know that one works */
+    uint8_t margin_idx = slower_rate(speed->best_idx, state);
+    uint8_t rate_idx   = margin_idx > speed->rate_idx ? margin_idx : speed->rate_idx;
+
+    if (rate_idx != speed->rate_idx)
+        commit_rate(rate_idx, state);
+    else
+        speed->phase = LINK_PHASE_IDLE;
+}
+
+static void begin_trial(uint8_t rate_idx, device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+    uint32_t now        = time_us_32();
+
+    speed->phase         = LINK_PHASE_TRIAL;
+    speed->trial_idx     = rate_idx;
+    speed->switched      = false;
+    speed->patterns_sent = false;
+    speed->good_patterns = 0;
+
+    if (speed->initiator) {
+        speed->switch_at = now + LINK_TRAIN_I_SWITCH_US;
+        speed->send_at   = now + LINK_TRAIN_I_SEND_US;
+        speed->revert_at = now + LINK_TRAIN_I_REVERT_US;
+        speed->deadline  = now + LINK_TRAIN_REPLY_US;
+    } else {
+        speed->switch_at = now + LINK_TRAIN_SWITCH_US;
+        speed->revert_at = now + LINK_TRAIN_REVERT_US;
+    }
+}
+
+static bool is_train_pattern(uart_packet_t *packet) {
+    uint8_t *pattern = &packet->data[LINK_TRAIN_PATTERN_IDX];
+    return memcmp(pattern, link_train_pattern, LINK_TRAIN_PATTERN_LENGTH) == 0;
+}
+
+/* Other board went away, both of us fall back to the boot rate on our own */
+void reset_link_speed(device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+
+    speed->phase    = LINK_PHASE_IDLE;
+    speed->trained  = false;
+    speed->rate_idx = LINK_BAUDRATE_DEFAULT_IDX;
+
+    set_link_baudrate(speed->rate_idx, state);
+}
+
+/* Runs on core1. From the config tool, validate_packet() lets only START through, that
+   just sets a flag for the link speed task. */
+void handle_link_train_msg(uart_packet_t *packet, device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+    uint8_t rate_idx    = packet->data[LINK_TRAIN_RATE_IDX];
+
+    if (packet->data[LINK_TRAIN_OP_IDX] == LINK_TRAIN_START) {
+        speed->requested = true;
+        return;
+    }
+
+    if (rate_idx >= LINK_BAUDRATE_COUNT)
+        return;
+
+    switch (packet->data[LINK_TRAIN_OP_IDX]) {
+        case LINK_TRAIN_PROPOSE:
+            /* Above our ceiling or not agreed on, report a failure straight away */
+            if (rate_idx > speed->ceiling_idx || !(state->link_baud_mask & (1 << rate_idx))) {
+                send_train_msg(LINK_TRAIN_REPORT, rate_idx, 0);
+                return;
+            }
+
+            speed->initiator = false;
+            send_train_msg(LINK_TRAIN_ACCEPT, rate_idx, 0);
+            begin_trial(rate_idx, state);
+            break;
+
+        case LINK_TRAIN_ACCEPT:
+            if (speed->initiator && speed->phase == LINK_PHASE_PROPOSED && rate_idx == speed->trial_idx)
+                begin_trial(rate_idx, state);
+            break;
+
+        case LINK_TRAIN_PATTERN:
+            if (!speed->initiator && speed->phase == LINK_PHASE_TRIAL && is_train_pattern(packet))
+                speed->good_patterns++;
+            break;
+
+        case LINK_TRAIN_REPORT:
+            if (!speed->initiator || rate_idx != speed->trial_idx)
+                break;
+
+            if (speed->phase == LINK_PHASE_PROPOSED || speed->phase == LINK_PHASE_RESULT)
+                finish_trial(packet->data[LINK_TRAIN_RESULT_IDX] >= LINK_TRAIN_PATTERNS, state);
+            break;
+
+        case LINK_TRAIN_COMMIT:
+            /* Both boards decided to commit at once, the slower rate wins */
+            if (speed->phase == LINK_PHASE_COMMITTING && rate_idx > speed->trial_idx)
+                break;
+
+            /* A repeat means our confirmation got lost, keep the switch time we gave */
+            if (speed->phase != LINK_PHASE_COMMIT || rate_idx != speed->trial_idx) {
+                speed->phase     = LINK_PHASE_COMMIT;
+                speed->trial_idx = rate_idx;
+                speed->switch_at = time_us_32() + LINK_TRAIN_COMMIT_US;
+            }
+
+            send_committed(state);
+            break;
+
+        case LINK_TRAIN_COMMITTED:
+            if (speed->phase != LINK_PHASE_COMMITTING || rate_idx != speed->trial_idx)
+                break;
+
+            speed->phase     = LINK_PHASE_COMMIT;
+            speed->switch_at = time_us_32() + packet->data[LINK_TRAIN_DELAY_IDX]
+                             + (packet->data[LINK_TRAIN_DELAY_IDX + 1] << 8);
+            break;
+    }
+}
+
+/* Step down a rate if too many frames arrive damaged */
+static void check_link_health(device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+    uint32_t errors     = state->link_rx_errors;
+
+    if (!deadline_passed(speed->health_checked + LINK_HEALTH_PERIOD_US))
+        return;
+
+    /* Counters might have been reset in the meantime */
+    uint32_t new_errors = errors >= speed->health_errors ? errors - speed->health_errors : errors;
+
+    speed->health_checked = time_us_32();
+    speed->health_errors  = errors;
+
+    /* Right after a rate change, errors may be leftovers from before it, e.g. patterns sent
+       at a failing trial rate. The first period only sets the baseline. */
+    if (!speed->health_settled) {
+        speed->health_settled = true;
+        return;
+    }
+
+    uint8_t lower_idx = slower_rate(speed->rate_idx, state);
+
+    if (new_errors <= LINK_HEALTH_MAX_ERRORS || lower_idx == speed->rate_idx)
+        return;
+
+    /* Don't train back up to a rate that let us down */
+    speed->ceiling_idx = lower_idx;
+    commit_rate(lower_idx, state);
+}
+
+void link_speed_task(device_t *state) {
+    link_speed_t *speed = &state->link_speed;
+
+    switch (speed->phase) {
+        case LINK_PHASE_IDLE:
+            /* Test patterns contain zeros, so this only works with COBS framing */
+            if ((~state->link_flags) & (LINK_FLAG_COBS | LINK_FLAG_SPEED))
+                return;
+
+            /* Asked for explicitly, so try everything again */
+            if (speed->requested) {
+                speed->requested   = false;
+                speed->ceiling_idx = LINK_BAUDRATE_COUNT - 1;
+                start_training(state);
+            } else if (!speed->trained && BOARD_ROLE == OUTPUT_A) {
+                start_training(state);
+            } else {
+                check_link_health(state);
+            }
+            break;
+
+        case LINK_PHASE_PROPOSED:
+        case LINK_PHASE_RESULT:
+            if (deadline_passed(speed->deadline))
+                finish_trial(false, state);
+            break;
+
+        case LINK_PHASE_TRIAL:
+            if (!speed->switched && deadline_passed(speed->switch_at)) {
+                set_link_baudrate(speed->trial_idx, state);
+                speed->switched = true;
+            }
+
+            bool send_due = speed->switched && !speed->patterns_sent && deadline_passed(speed->send_at);
+
+            if (speed->initiator && send_due) {
+                send_train_patterns(speed->trial_idx);
+                speed->patterns_sent = true;
+            }
+
+            if (!deadline_passed(speed->revert_at))
+                break;
+
+            set_link_baudrate(speed->rate_idx, state);
+
+            if (speed->initiator) {
+                speed->phase = LINK_PHASE_RESULT;
+            } else {
+                send_train_msg(LINK_TRAIN_REPORT, speed->trial_idx, speed->good_patterns);
+                speed->phase = LINK_PHASE_IDLE;
+            }
+            break;
+
+        case LINK_PHASE_COMMITTING:
+            if (!deadline_passed(speed->deadline))
+                break;
+
+            /* Other board can't hear us, stay where we are, a timeout resets both if needed */
+            if (speed->commit_tries < LINK_TRAIN_COMMIT_TRIES)
+                send_commit(state);
+            else
+                speed->phase = LINK_PHASE_IDLE;
+            break;
+
+        case LINK_PHASE_COMMIT:
+            if (!deadline_passed(speed->switch_at))
+                break;
+
+            speed->rate_idx = speed->trial_idx;
+            speed->phase    = LINK_PHASE_IDLE;
+            set_link_baudrate(speed->rate_idx, state);
+            break;
+    }
+}
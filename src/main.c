@@ -26,22 +26,18 @@ int main(void) {
     static task_t tasks_core0[] = {
         [0] = {.exec = &usb_device_task,          .frequency = _TOP()},      // .-> USB device task, needs to run as often as possible
         [1] = {.exec = &kick_watchdog_task,       .frequency = _HZ(30)},     // | Verify core1 is still running and if so, reset watchdog timer
-        [2] = {.exec = &process_kbd_queue_task,   .frequency = _HZ(2000)},   // | Check if there were any keypresses and send them
-        [3] = {.exec = &process_mouse_queue_task, .frequency = _HZ(2000)},   // | Check if there were any mouse movements and send them
-        [4] = {.exec = &process_hid_queue_task,   .frequency = _HZ(1000)},   // | Check if there are any packets to send over vendor link
-        [5] = {.exec = &process_uart_tx_task,     .frequency = _TOP()},      // | Check if there are any packets to send over UART
+        [2] = {.exec = &process_outbound_task,    .frequency = _TOP()},      // | Send queued keyboard, mouse, control and vendor reports
+        [3] = {.exec = &process_uart_tx_task,     .frequency = _TOP()},      // | Check if there are any packets to send over UART
+        [4] = {.exec = &stats_task,               .frequency = _HZ(1)},      // | Refresh report rate and queue statistics
     };                                                                       // `----- then go back and repeat forever
     const int NUM_TASKS = ARRAY_SIZE(tasks_core0);
 
     // Wait for the board to settle
     sleep_ms(10);
 
-    // Initial board setup
+    // Initial board setup, also selects A as the default output
     initial_setup(device);
 
-    // Initial state, A is the default output
-    set_active_output(device, OUTPUT_A);
-
     while (true) {
         for (int i = 0; i < NUM_TASKS; i++)
             task_scheduler(device, &tasks_core0[i]);
@@ -54,9 +50,17 @@ void core1_main() {
         [1] = {.exec = &packet_receiver_task,    .frequency = _TOP()},       // | Receive data over serial from the other board
         [2] = {.exec = &led_blinking_task,       .frequency = _HZ(30)},      // | Check if LED needs blinking
         [3] = {.exec = &heartbeat_output_task,   .frequency = _HZ(1)},       // | Output periodic heartbeats
+        [4] = {.exec = &process_mouse_link_task, .frequency = _HZ(2000)},    // | Send coalesced mouse motion to the other board
+        [5] = {.exec = &process_set_report_task, .frequency = _HZ(1000)},    // | Process set reports the computer sent to core0
+        [6] = {.exec = &link_speed_task,         .frequency = _HZ(2000)},    // | Train the link baud rate and watch its error rate
+        [7] = {.exec = &kbd_sync_task,           .frequency = _HZ(4)},       // | Send keyboard state snapshots to the other board
+        [8] = {.exec = &resend_values_task,      .frequency = _HZ(1000)},    // | Retry state changes that found their lane full
     };                                                                       // `----- then go back and repeat forever
     const int NUM_TASKS = ARRAY_SIZE(tasks_core1);
 
+    /* UART receive interrupt needs to be enabled from this core to be delivered here */
+    configure_rx_irq();
+
     while (true) {
         // Update the timestamp, so core0 can figure out if we're dead
         device->core1_last_loop_pass = time_us_64();
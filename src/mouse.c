@@ -10,28 +10,227 @@
  */
 
 #include "main.h"
-#include <math.h>
 
+/* Cheap speed estimate without a square root, max + min/2 is within ~12% of the magnitude */
+static inline int32_t approx_speed(int32_t x, int32_t y) {
+    x = x < 0 ? -x : x;
+    y = y < 0 ? -y : y;
 
-/* Process mouse movement and update button state */
+    return x > y ? x + (y >> 1) : y + (x >> 1);
+}
+
+static inline int32_t clamp(int32_t value, int32_t min, int32_t max) {
+    return value < min ? min : (value > max ? max : value);
+}
+
+/* Scale one axis by gain (Q8) and carry the fractional part over to the next report,
+   so slow movements aren't rounded away. The shift floors, remainder stays in [0, 255]. */
+static inline int32_t scale_axis(int32_t move, int32_t gain, int32_t *remainder) {
+    int32_t scaled = move * gain + *remainder;
+    int32_t result = scaled >> 8;
+
+    *remainder = scaled - result * 256;
+    return result;
+}
+
+/* Process mouse movement, scale it for the output it's headed to */
 void update_mouse_position(device_t *state, mouse_values_t *values) {
-    /* Update buttons state */
-    state->mouse_buttons = values->buttons;
-    
-    /* For now, just pass through the raw mouse values - we'll remove scaling later */
+    output_t *output = &state->config.output[state->active_output];
+    int32_t accel    = 1 << 8;
+
+    /* Keep the product below 2^31: 18-bit move * 128 speed * 4.0 accel, all fits */
+    values->move_x = clamp(values->move_x, -MOUSE_MOVE_LIMIT, MOUSE_MOVE_LIMIT);
+    values->move_y = clamp(values->move_y, -MOUSE_MOVE_LIMIT, MOUSE_MOVE_LIMIT);
+
+    if (state->config.enable_acceleration) {
+        int32_t speed = approx_speed(values->move_x, values->move_y);
+        accel = mouse_accel_lut[speed < MOUSE_ACCEL_LUT_SIZE ? speed : MOUSE_ACCEL_LUT_SIZE - 1];
+    }
+
+    /* Speed is in 1/16 steps, accel in Q8, so the gain ends up in Q8 as well */
+    int32_t gain_x = clamp(output->speed_x, 1, MOUSE_SPEED_MAX) * accel / MOUSE_SPEED_UNITY;
+    int32_t gain_y = clamp(output->speed_y, 1, MOUSE_SPEED_MAX) * accel / MOUSE_SPEED_UNITY;
+
+    values->move_x = scale_axis(values->move_x, gain_x, &state->mouse_remainder_x);
+    values->move_y = scale_axis(values->move_y, gain_y, &state->mouse_remainder_y);
+}
+
+/* Take as much of the accumulated value as fits the report field, leave the rest for later */
+static inline int32_t take_saturated(int32_t *value, int32_t min, int32_t max) {
+    int32_t chunk = clamp(*value, min, max);
+    *value -= chunk;
+    return chunk;
+}
+
+/* Move (part of) the pending motion into a report. For mouse_acc, hold mouse_lock. */
+static void take_mouse_motion(mouse_accumulator_t *acc, mouse_report_t *report) {
+    *report = (mouse_report_t){
+        .buttons = acc->buttons,
+        .x       = take_saturated(&acc->x, INT16_MIN, INT16_MAX),
+        .y       = take_saturated(&acc->y, INT16_MIN, INT16_MAX),
+        .wheel   = take_saturated(&acc->wheel, INT8_MIN, INT8_MAX),
+        .pan     = take_saturated(&acc->pan, INT8_MIN, INT8_MAX),
+        .mode    = RELATIVE,
+    };
+
+    /* Anything that didn't fit goes out with the next frame */
+    acc->pending = acc->x || acc->y || acc->wheel || acc->pan;
+}
+
+/* Add relative motion to the pending sums. They are capped at a few reports worth of motion,
+   so a stalled host can't overflow them or have a long burst of reports dumped on it. */
+static void add_motion(mouse_accumulator_t *acc, int32_t x, int32_t y, int32_t wheel, int32_t pan) {
+    acc->x     = clamp(acc->x + x, -MOUSE_ACC_FRAMES * INT16_MAX, MOUSE_ACC_FRAMES * INT16_MAX);
+    acc->y     = clamp(acc->y + y, -MOUSE_ACC_FRAMES * INT16_MAX, MOUSE_ACC_FRAMES * INT16_MAX);
+    acc->wheel = clamp(acc->wheel + wheel, -MOUSE_ACC_FRAMES * INT8_MAX, MOUSE_ACC_FRAMES * INT8_MAX);
+    acc->pan   = clamp(acc->pan + pan, -MOUSE_ACC_FRAMES * INT8_MAX, MOUSE_ACC_FRAMES * INT8_MAX);
+}
+
+static void add_mouse_motion(mouse_accumulator_t *acc, const mouse_values_t *values) {
+    add_motion(acc, values->move_x, values->move_y, values->wheel, values->pan);
+    acc->pending = acc->x || acc->y || acc->wheel || acc->pan;
+}
+
+/* A report couldn't go out, return its motion to the pending sums. Its button state still
+   has to reach the other side, so it stays pending even if there was no motion. */
+static void return_mouse_motion(mouse_accumulator_t *acc, const mouse_report_t *report) {
+    add_motion(acc, report->x, report->y, report->wheel, report->pan);
+    acc->pending = true;
+}
+
+typedef bool (*mouse_emit_f)(mouse_report_t *, device_t *);
+
+/* Fold new values into the accumulator. A button change is a discrete event: motion pending
+   with the old button state is emitted first, then a report carrying the new state. Whatever
+   doesn't fit into the report fields stays pending. If a report is refused, it goes back to
+   the accumulator, which always ends up with the latest buttons. Flushing old motion takes at
+   most as many reports as the accumulator can hold, whatever is left after that is dropped. */
+static void accumulate_mouse_values(mouse_accumulator_t *acc,
+                                    const mouse_values_t *values,
+                                    mouse_emit_f emit,
+                                    device_t *state) {
+    mouse_report_t report;
+
+    if ((uint8_t)values->buttons == acc->buttons) {
+        add_mouse_motion(acc, values);
+        return;
+    }
+
+    for (int i = 0; acc->pending && i < MOUSE_ACC_FRAMES; i++) {
+        take_mouse_motion(acc, &report);
+
+        if (!emit(&report, state))
+            break;
+    }
+
+    /* Whatever the queue couldn't take is dropped, it mustn't go out with the new buttons */
+    *acc = (mouse_accumulator_t){.buttons = values->buttons};
+    add_mouse_motion(acc, values);
+
+    take_mouse_motion(acc, &report);
+    if (!emit(&report, state))
+        return_mouse_motion(acc, &report);
+}
+
+/* ==================================================== *
+ * Mouse Link Section
+ * ==================================================== */
+
+static bool send_mouse_link_report(mouse_report_t *report, device_t *state) {
+    queue_packet((uint8_t *)report, MOUSE_REPORT_MSG, MOUSE_REPORT_LENGTH);
+    state->mouse_link_last_tx = time_us_64();
+    return true;
 }
 
-/* If we are active output, queue packet to mouse queue, else send them through UART */
-void output_mouse_report(mouse_report_t *report, device_t *state) {
+/* Send whatever fits into one packet, if a frame interval has passed since the last one */
+static void flush_mouse_link(device_t *state) {
+    mouse_report_t report;
+
+    if (!state->mouse_link_acc.pending)
+        return;
+
+    if (time_us_64() - state->mouse_link_last_tx < MOUSE_LINK_FRAME_US)
+        return;
+
+    take_mouse_motion(&state->mouse_link_acc, &report);
+    send_mouse_link_report(&report, state);
+}
+
+/* Motion headed for the other board is coalesced to at most one packet per USB frame,
+   the receiving side can't forward more than that anyway. Button changes go out
+   immediately, preceded by any motion still pending. */
+static void coalesce_mouse_link_values(mouse_values_t *values, device_t *state) {
+    accumulate_mouse_values(&state->mouse_link_acc, values, send_mouse_link_report, state);
+    flush_mouse_link(state);
+}
+
+/* Periodically push out coalesced motion that didn't make it out with its report */
+void process_mouse_link_task(device_t *state) {
+    /* We became the active output in the meantime, motion for the other board is stale */
     if (CURRENT_BOARD_IS_ACTIVE_OUTPUT) {
-        queue_mouse_report(report, state);
+        state->mouse_link_acc = (mouse_accumulator_t){.buttons = state->mouse_link_acc.buttons};
+        return;
+    }
+
+    flush_mouse_link(state);
+}
+
+/* If we are active output, queue values for our host, else send them through UART */
+void output_mouse_report(mouse_values_t *values, device_t *state) {
+    if (CURRENT_BOARD_IS_ACTIVE_OUTPUT) {
+        queue_mouse_report(values, state);
         state->last_activity[BOARD_ROLE] = time_us_64();
     } else {
-        queue_packet((uint8_t *)report, MOUSE_REPORT_MSG, MOUSE_REPORT_LENGTH);
+        coalesce_mouse_link_values(values, state);
     }
 }
 
 
+/* ==================================================== *
+ * Pointer Merging
+ * ==================================================== */
+
+/* Each local HID interface is its own pointer source, identified by its slot in iface[][] */
+static inline uint8_t mouse_source(device_t *state, hid_interface_t *iface) {
+    return iface - &state->iface[0][0];
+}
+
+/* Record the buttons of one pointer and return the combined state of all of them, so one
+   device releasing a button doesn't release a button held on another. Buttons from the
+   other board only count while we are the output they are meant for. */
+uint8_t merge_mouse_buttons(device_t *state, uint8_t source, uint8_t buttons) {
+    int sources    = CURRENT_BOARD_IS_ACTIVE_OUTPUT ? MOUSE_SOURCES : MOUSE_SOURCE_REMOTE;
+    uint8_t merged = 0;
+
+    state->mouse_source_buttons[source] = buttons;
+
+    for (int i = 0; i < sources; i++)
+        merged |= state->mouse_source_buttons[i];
+
+    state->mouse_buttons = merged;
+    return merged;
+}
+
+/* A pointer went away (unplugged, or the other board stopped being our source), make sure
+   buttons it was holding get released */
+void release_mouse_source(device_t *state, uint8_t source) {
+    if (source >= MOUSE_SOURCES || !state->mouse_source_buttons[source])
+        return;
+
+    mouse_values_t values = {.buttons = merge_mouse_buttons(state, source, 0)};
+    output_mouse_report(&values, state);
+}
+
+/* Output changed, buttons held on the other board's pointer were meant for the previous one.
+   They only ever reach our own computer, so that's where the report without them goes. */
+void release_remote_mouse_buttons(device_t *state) {
+    if (!state->mouse_source_buttons[MOUSE_SOURCE_REMOTE])
+        return;
+
+    mouse_values_t values = {.buttons = merge_mouse_buttons(state, MOUSE_SOURCE_REMOTE, 0)};
+    queue_mouse_report(&values, state);
+}
+
 static inline bool extract_value(bool uses_id, int32_t *dst, report_val_t *src, uint8_t *raw_report, int len) {
     /* If HID Report ID is used, the report is prefixed by the report ID so we have to move by 1 byte */
     if (uses_id && (*raw_report++ != src->report_id))
@@ -62,23 +261,10 @@ void extract_report_values(uint8_t *raw_report, int len, device_t *state, mouse_
     extract_value(uses_id, &values->pan, &mouse->pan, raw_report, len);
 
     if (!extract_value(uses_id, &values->buttons, &mouse->buttons, raw_report, len)) {
-        values->buttons = state->mouse_buttons;
+        values->buttons = state->mouse_source_buttons[mouse_source(state, iface)];
     }
 }
 
-mouse_report_t create_mouse_report(device_t *state, mouse_values_t *values) {
-    mouse_report_t mouse_report = {
-        .buttons = values->buttons,
-        .x       = values->move_x,
-        .y       = values->move_y,
-        .wheel   = values->wheel,
-        .pan     = values->pan,
-        .mode    = RELATIVE,
-    };
-
-    return mouse_report;
-}
-
 void process_mouse_report(uint8_t *raw_report, int len, uint8_t itf, hid_interface_t *iface) {
     mouse_values_t values = {0};
     device_t *state = &global_state;
@@ -94,53 +280,95 @@ void process_mouse_report(uint8_t *raw_report, int len, uint8_t itf, hid_interfa
     /* Calculate and update mouse movement with acceleration. */
     update_mouse_position(state, &values);
 
-    /* Create the report for the output PC based on the updated values */
-    mouse_report_t report = create_mouse_report(state, &values);
+    /* Buttons are OR-ed across all pointers, motion is summed later in the accumulator */
+    values.buttons = merge_mouse_buttons(state, mouse_source(state, iface), values.buttons);
 
-    /* Send the mouse report */
-    output_mouse_report(&report, state);
+    /* Send the values on, they are only narrowed to report fields once they leave the board */
+    output_mouse_report(&values, state);
 }
 
 /* ==================================================== *
  * Mouse Queue Section
  * ==================================================== */
 
-void process_mouse_queue_task(device_t *state) {
-    mouse_report_t report = {0};
+/* Send the next mouse report, called by the outbound scheduler once the endpoint is ready.
+   Button transitions go first, then whatever motion accumulated since. */
+bool send_queued_mouse_report(device_t *state) {
+    mouse_report_t motion = {0};
+    mouse_report_t *report = ring_front(&state->mouse_queue);
 
-    /* If NULL MODE is active, don't send any mouse reports */
-    if (state->null_mode)
-        return;
+    if (report == NULL) {
+        /* Queued reports go first, even if the newest one is being merged into right now */
+        if (!state->mouse_acc.pending || !ring_is_empty(&state->mouse_queue))
+            return false;
 
-    /* We need to be connected to the host to send messages */
-    if (!state->tud_connected)
-        return;
-
-    /* Peek first, if there is anything there... */
-    if (!queue_try_peek(&state->mouse_queue, &report))
-        return;
-
-    /* If we are suspended, let's wake the host up */
-    if (tud_suspended())
-        tud_remote_wakeup();
+        critical_section_enter_blocking(&state->mouse_lock);
+        take_mouse_motion(&state->mouse_acc, &motion);
+        critical_section_exit(&state->mouse_lock);
+    }
 
-    /* If it's not ready, we'll try on the next pass */
-    if (!tud_hid_n_ready(ITF_NUM_HID))
-        return;
+    mouse_report_t *r = report ? report : &motion;
 
     /* Try sending it to the host, if it's successful */
-    bool succeeded
-        = tud_mouse_report(report.mode, report.buttons, report.x, report.y, report.wheel, report.pan);
+    bool succeeded = tud_mouse_report(r->mode, r->buttons, r->x, r->y, r->wheel, r->pan);
 
     /* ... then we can remove it from the queue */
-    if (succeeded)
-        queue_try_remove(&state->mouse_queue, &report);
+    if (report != NULL) {
+        if (succeeded)
+            ring_release(&state->mouse_queue);
+        else
+            ring_keep(&state->mouse_queue);
+        return succeeded;
+    }
+
+    /* Failed to send accumulated motion, so put it back */
+    if (!succeeded) {
+        critical_section_enter_blocking(&state->mouse_lock);
+        return_mouse_motion(&state->mouse_acc, &motion);
+        critical_section_exit(&state->mouse_lock);
+    }
+
+    return succeeded;
+}
+
+/* Fold a report into the newest one still queued for the host, as long as both carry the
+   same buttons and the sums fit the report fields. Otherwise it's a separate event. */
+bool merge_mouse_report(void *newest, const void *element) {
+    mouse_report_t *queued       = newest;
+    const mouse_report_t *report = element;
+
+    int32_t x     = queued->x + report->x;
+    int32_t y     = queued->y + report->y;
+    int32_t wheel = queued->wheel + report->wheel;
+    int32_t pan   = queued->pan + report->pan;
+
+    if (queued->buttons != report->buttons || queued->mode != report->mode)
+        return false;
+
+    if (x != (int16_t)x || y != (int16_t)y || wheel != (int8_t)wheel || pan != (int8_t)pan)
+        return false;
+
+    queued->x     = x;
+    queued->y     = y;
+    queued->wheel = wheel;
+    queued->pan   = pan;
+    return true;
+}
+
+static bool queue_mouse_event(mouse_report_t *report, device_t *state) {
+    return ring_try_add(&state->mouse_queue, report);
 }
 
-void queue_mouse_report(mouse_report_t *report, device_t *state) {
+/* Relative motion is summed into a single pending report, only button transitions are
+   queued as discrete events. Motion collected before a transition is merged into the
+   newest queued report or queued ahead of it, so clicks still land where the cursor was
+   when the button changed. With the queue full, the rest waits in the accumulator. */
+void queue_mouse_report(mouse_values_t *values, device_t *state) {
     /* It wouldn't be fun to queue up a bunch of messages and then dump them all on host */
     if (!state->tud_connected)
         return;
 
-    queue_try_add(&state->mouse_queue, report);
+    critical_section_enter_blocking(&state->mouse_lock);
+    accumulate_mouse_values(&state->mouse_acc, values, queue_mouse_event, state);
+    critical_section_exit(&state->mouse_lock);
 }
@@ -10,6 +10,19 @@
  */
 #include "main.h"
 
+#define HOTKEY_FIELDS(n, idx)                                                         \
+    { idx,     false, UINT32, 4, offsetof(device_t, config.hotkeys[n].modifier) },    \
+    { idx + 1, false, UINT8,  1, offsetof(device_t, config.hotkeys[n].action) },      \
+    { idx + 2, false, UINT8,  1, offsetof(device_t, config.hotkeys[n].pass_to_os) }
+
+/* Telemetry of one queue, enqueued, dropped, depth, high-water mark and max wait (us) */
+#define QUEUE_FIELDS(queue, idx)                                                     \
+    { idx,     true,  UINT32, 4, offsetof(device_t, queue.stats.enqueued) },         \
+    { idx + 1, true,  UINT32, 4, offsetof(device_t, queue.stats.dropped) },          \
+    { idx + 2, true,  UINT32, 4, offsetof(device_t, queue.stats.depth) },            \
+    { idx + 3, true,  UINT32, 4, offsetof(device_t, queue.stats.high_water) },       \
+    { idx + 4, true,  UINT32, 4, offsetof(device_t, queue.stats.max_wait_us) }
+
 const field_map_t api_field_map[] = {
 /* Index, Rdonly, Type, Len, Offset in struct */
     { 0,  true,  UINT8,  1, offsetof(device_t, active_output) },
@@ -32,7 +45,8 @@ const field_map_t api_field_map[] = {
     { 71, false, UINT8,  1, offsetof(device_t, config.force_mouse_boot_mode) },
     { 72, false, UINT8,  1, offsetof(device_t, config.force_kbd_boot_protocol) },
     { 73, false, UINT8,  1, offsetof(device_t, config.kbd_led_as_indicator) },
-    { 74, false, UINT8,  1, offsetof(device_t, config.hotkey_toggle) },
+    { 74, false, UINT8,  1, offsetof(device_t, config.hotkeys[0].keys[0]) },
+    { 75, false, UINT8,  1, offsetof(device_t, config.enable_acceleration) },
     { 76, false, UINT8,  1, offsetof(device_t, config.enforce_ports) },
 
     /* Firmware */
@@ -41,6 +55,73 @@ const field_map_t api_field_map[] = {
 
     { 80, true,  UINT8,  1, offsetof(device_t, keyboard_connected) },
     { 82, true,  UINT8,  1, offsetof(device_t, relative_mouse) },
+
+    /* Hotkeys, combo is modifier + up to 3 keycodes packed in one 32-bit value */
+    HOTKEY_FIELDS(0, 100),
+    HOTKEY_FIELDS(1, 104),
+    HOTKEY_FIELDS(2, 108),
+    HOTKEY_FIELDS(3, 112),
+    HOTKEY_FIELDS(4, 116),
+    HOTKEY_FIELDS(5, 120),
+    HOTKEY_FIELDS(6, 124),
+    HOTKEY_FIELDS(7, 128),
+
+    /* Report rate meter, select the interface and read back its summary */
+    { 140, false, UINT8,  1, offsetof(device_t, report_rate_view.iface) },
+    { 141, true,  UINT16, 2, offsetof(device_t, report_rate_view.rate_hz) },
+    { 142, true,  UINT16, 2, offsetof(device_t, report_rate_view.p50_us) },
+    { 143, true,  UINT16, 2, offsetof(device_t, report_rate_view.p99_us) },
+    { 144, true,  UINT32, 4, offsetof(device_t, report_rate_view.max_us) },
+    { 145, true,  UINT32, 4, offsetof(device_t, report_rate_view.gaps) },
+    { 146, true,  UINT32, 4, offsetof(device_t, report_rate_view.process_us) },
+
+    /* Queue telemetry, cleared with RESET_STATS_MSG */
+    QUEUE_FIELDS(kbd_queue, 150),
+    QUEUE_FIELDS(mouse_queue, 155),
+    QUEUE_FIELDS(hid_queue_out, 160),
+    QUEUE_FIELDS(uart_tx_queue[UART_LANE_INPUT], 165),
+    QUEUE_FIELDS(set_report_queue, 170),
+    QUEUE_FIELDS(vendor_queue, 175),
+
+    /* Most bytes waiting in the UART RX ring at the start of a receiver pass */
+    { 180, true,  UINT32, 4, offsetof(device_t, rx_backlog_max) },
+
+    /* UART RX bytes received and worst case time from a frame landing to it being handled */
+    { 181, true,  UINT32, 4, offsetof(device_t, rx_bytes) },
+    { 182, true,  UINT32, 4, offsetof(device_t, rx_latency_max_us) },
+
+    /* Reliable link delivery: packets resent, duplicates dropped, packets given up on */
+    { 183, true,  UINT32, 4, offsetof(device_t, link_retransmits) },
+    { 184, true,  UINT32, 4, offsetof(device_t, link_duplicates) },
+    { 185, true,  UINT32, 4, offsetof(device_t, link_lost) },
+
+    /* Link speed: current baud rate and frames that arrived damaged */
+    { 186, true,  UINT32, 4, offsetof(device_t, link_baudrate) },
+    { 187, true,  UINT32, 4, offsetof(device_t, link_rx_errors) },
+
+    /* Link round trip: best recent, smoothed, worst and spikes, then the clock offset */
+    { 188, true,  UINT32, 4, offsetof(device_t, link_clock.rtt_us) },
+    { 189, true,  UINT32, 4, offsetof(device_t, link_clock.srtt_us) },
+    { 190, true,  UINT32, 4, offsetof(device_t, link_clock.rtt_max_us) },
+    { 191, true,  UINT32, 4, offsetof(device_t, link_clock.rtt_spikes) },
+    { 192, true,  INT32,  4, offsetof(device_t, link_clock.offset_us) },
+
+    /* Negotiated link features and the caps version the other board sent */
+    { 193, true,  UINT32, 4, offsetof(device_t, link_flags) },
+    { 194, true,  UINT8,  1, offsetof(device_t, link_peer_caps) },
+
+    /* Keyboard state sync: version gaps, each one healed by a snapshot */
+    { 195, true,  UINT32, 4, offsetof(device_t, kbd_sync_rx.gaps) },
+
+    /* Telemetry for the other two UART TX lanes, input is at 165 */
+    QUEUE_FIELDS(uart_tx_queue[UART_LANE_CONTROL], 196),
+    QUEUE_FIELDS(uart_tx_queue[UART_LANE_BULK], 201),
+
+    /* Link health: bad legacy checksums, bytes skipped resyncing, unknown types, RX overruns */
+    { 206, true,  UINT32, 4, offsetof(device_t, link_checksum_errors) },
+    { 207, true,  UINT32, 4, offsetof(device_t, link_discarded) },
+    { 208, true,  UINT32, 4, offsetof(device_t, link_unknown_types) },
+    { 209, true,  UINT32, 4, offsetof(device_t, link_overruns) },
 };
 
 const field_map_t* get_field_map_entry(uint32_t index) {
@@ -66,22 +147,60 @@ size_t get_field_map_length(void) {
     return ARRAY_SIZE(api_field_map);
 }
 
+/* Reserves a slot in the outgoing HID queue and fills in the header, payload is written in place */
+static hid_generic_pkt_t *claim_hid_packet(device_t *state, uint8_t type, uint8_t len, uint8_t id, uint8_t inst) {
+    ring_t *queue = (inst == ITF_NUM_HID_VENDOR) ? &state->vendor_queue : &state->hid_queue_out;
+    hid_generic_pkt_t *generic_packet = ring_claim(queue);
+
+    if (generic_packet == NULL)
+        return NULL;
+
+    generic_packet->instance  = inst;
+    generic_packet->report_id = id;
+    generic_packet->type      = type;
+    generic_packet->len       = len;
+
+    return generic_packet;
+}
+
 void _queue_packet(uint8_t *payload, device_t *state, uint8_t type, uint8_t len, uint8_t id, uint8_t inst) {
-    hid_generic_pkt_t generic_packet = {
-        .instance = inst,
-        .report_id = id,
-        .type = type,
-        .len = len,
-    };
-
-    memcpy(generic_packet.data, payload, len);
-    queue_try_add(&state->hid_queue_out, &generic_packet);
+    hid_generic_pkt_t *generic_packet = claim_hid_packet(state, type, len, id, inst);
+
+    if (generic_packet == NULL)
+        return;
+
+    memcpy(generic_packet->data, payload, len);
+    ring_commit(inst == ITF_NUM_HID_VENDOR ? &state->vendor_queue : &state->hid_queue_out);
 }
 
 void queue_cfg_packet(uart_packet_t *packet, device_t *state) {
-    uint8_t raw_packet[RAW_PACKET_LENGTH];
-    write_raw_packet(raw_packet, packet);
-    _queue_packet(raw_packet, state, 0, RAW_PACKET_LENGTH, REPORT_ID_VENDOR, ITF_NUM_HID_VENDOR);
+    hid_generic_pkt_t *generic_packet
+        = claim_hid_packet(state, 0, RAW_PACKET_LENGTH, REPORT_ID_VENDOR, ITF_NUM_HID_VENDOR);
+
+    if (generic_packet == NULL)
+        return;
+
+    write_raw_packet(generic_packet->data, packet);
+    ring_commit(&state->vendor_queue);
+}
+
+/* Send the oldest packet from a generic HID queue, called by the outbound scheduler */
+bool send_queued_hid_packet(ring_t *queue) {
+    hid_generic_pkt_t *packet = ring_front(queue);
+
+    if (packet == NULL)
+        return false;
+
+    /* Try sending it to the host straight from the queue slot, if it's successful */
+    bool succeeded = tud_hid_n_report(packet->instance, packet->report_id, packet->data, packet->len);
+
+    /* ... then we can remove it from the queue */
+    if (succeeded)
+        ring_release(queue);
+    else
+        ring_keep(queue);
+
+    return succeeded;
 }
 
 void queue_cc_packet(uint8_t *payload, device_t *state) {
@@ -0,0 +1,283 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+
+#include "main.h"
+
+/* ================================================== *
+ * ===========  Lock-free SPSC Ring Buffer  ========= *
+ * ================================================== *
+ *
+ * The producer writes the element first and only then publishes the new head, the
+ * consumer reads the element first and only then publishes the new tail. The memory
+ * barriers make sure the other core can't observe the counter before the element
+ * is complete, and keep the compiler from reordering the two.
+ *
+ * Both sides can work on the slot in place (claim/commit and front/release), which
+ * avoids building elements on the stack and copying them in and out.
+ *
+ * Dropping the newest element on overflow can lose a key or button release and leave
+ * it stuck on the computer. Rings with a different policy reserve a quarter of their
+ * slots as headroom. Once the soft limit is exceeded, the producer still commits the
+ * new element and advances skip, the consumer then jumps its tail over the superseded
+ * elements. Only the consumer ever touches the tail, so this remains lock-free.
+ *
+ * If the consumer stalls (host suspended, endpoint busy), the tail doesn't move and the
+ * ring fills up with superseded elements. The producer then reuses their slots, so the
+ * newest element - often the final key or button release - is never the one dropped.
+ * The only slot it must not touch is the one the consumer is reading. The consumer
+ * announces that slot in reading before it looks at skip, the producer publishes skip
+ * before it looks at reading, so at least one of them sees the other.
+ *
+ * Rings with RING_MERGE never discard anything on their own. When adding, the producer
+ * first tries folding the element into the newest one still waiting, e.g. summing mouse
+ * motion. It announces that slot in merging the same way, a consumer that finds its slot
+ * being merged into backs off and reports the ring as busy. If the merge is refused and
+ * there is no room either, adding fails and the caller keeps the element.
+ */
+
+void ring_init(ring_t *ring,
+               void *storage,
+               uint32_t *stamps,
+               uint16_t elem_size,
+               uint16_t capacity,
+               ring_policy_e policy) {
+    ring->data      = storage;
+    ring->stamps    = stamps;
+    ring->elem_size = elem_size;
+    ring->mask      = capacity - 1;
+    ring->policy    = policy;
+    ring->limit     = capacity - capacity / 4;
+    ring->head      = 0;
+    ring->tail      = 0;
+    ring->skip      = 0;
+    ring->reading   = 0;
+    ring->merging   = 0;
+    ring->merge     = NULL;
+
+    /* These never skip anything, so there's no need for headroom */
+    if (policy == RING_DROP_NEWEST || policy == RING_MERGE)
+        ring->limit = capacity;
+
+    ring_reset_stats(ring);
+}
+
+/* Sets the function used to combine elements of a RING_MERGE ring */
+void ring_set_merge(ring_t *ring, ring_merge_f merge) {
+    ring->merge = merge;
+}
+
+static inline uint8_t *ring_slot(ring_t *ring, uint32_t counter) {
+    return &ring->data[(counter & ring->mask) * ring->elem_size];
+}
+
+/* Producer side. The ring is full, but the slot we'd write next may hold an element that
+   was superseded and is only waiting for the consumer to jump over it. */
+static bool ring_reclaim(ring_t *ring, uint32_t head) {
+    uint32_t oldest = head - ring->mask - 1;
+
+    /* Rings without headroom never supersede anything */
+    if (ring->limit > ring->mask || (int32_t)(ring->skip - oldest) <= 0)
+        return false;
+
+    /* Skip is already published, see if the consumer got to this slot before it saw it */
+    __dmb();
+    return ring->reading != (oldest & ring->mask) + 1;
+}
+
+/* Producer side. Reserves the next free slot so the element can be built in place,
+   returns NULL if the ring is full. Nothing is visible to the consumer until commit. */
+void *ring_claim(ring_t *ring) {
+    uint32_t head = ring->head;
+
+    if (head - ring->tail > ring->mask && !ring_reclaim(ring, head)) {
+        ring->stats.dropped++;
+        return NULL;
+    }
+
+    /* Acquire: slot must be released by the consumer before we overwrite it */
+    __dmb();
+    return ring_slot(ring, head);
+}
+
+/* Producer side. Publishes the slot returned by the last ring_claim(). */
+void ring_commit(ring_t *ring) {
+    uint32_t head = ring->head;
+
+    ring->stamps[head & ring->mask] = time_us_32();
+
+    /* Release: element contents become visible before the new head does */
+    __dmb();
+    ring->head = ++head;
+
+    uint32_t level = ring_level(ring);
+
+    ring->stats.enqueued++;
+    if (level > ring->stats.high_water)
+        ring->stats.high_water = level;
+
+    if (level <= ring->limit)
+        return;
+
+    /* Over the soft limit, mark older elements as superseded so the consumer skips them */
+    uint32_t skip = (ring->policy == RING_SNAPSHOT) ? head - 1 : head - ring->limit;
+    uint32_t from = ((int32_t)(ring->skip - ring->tail) > 0) ? ring->skip : ring->tail;
+
+    if ((int32_t)(skip - from) > 0)
+        ring->stats.dropped += skip - from;
+
+    ring->skip = skip;
+}
+
+/* Consumer side. Returns a pointer to the oldest element, or NULL if the ring is empty.
+   The slot stays valid and unchanged until ring_release() is called. */
+void *ring_front(ring_t *ring) {
+    uint32_t tail = ring->tail;
+    uint32_t skip;
+
+    /* Announce the slot before checking skip, the producer won't reuse it unless it's
+       superseded and we're not on it. If it was superseded, drop it without reading. */
+    while (true) {
+        ring->reading = (tail & ring->mask) + 1;
+        __dmb();
+        skip = ring->skip;
+
+        if ((int32_t)(skip - tail) <= 0)
+            break;
+
+        tail       = skip;
+        ring->tail = tail;
+    }
+
+    /* Producer is folding something into this very slot, come back later */
+    if (ring->head == tail || ring->merging == ring->reading) {
+        ring->reading = 0;
+        return NULL;
+    }
+
+    /* Acquire: don't read the slot before we've seen the head covering it */
+    __dmb();
+    return ring_slot(ring, tail);
+}
+
+/* Consumer side. Hands the slot returned by ring_front() back to the producer. */
+void ring_release(ring_t *ring) {
+    uint32_t tail = ring->tail;
+    uint32_t wait = time_us_32() - ring->stamps[tail & ring->mask];
+
+    if (wait > ring->stats.max_wait_us)
+        ring->stats.max_wait_us = wait;
+
+    /* Release: we're done reading the slot before producer is allowed to reuse it */
+    __dmb();
+    ring->tail = tail + 1;
+
+    /* A producer that sees we're off the slot must also see it's gone */
+    __dmb();
+    ring->reading = 0;
+}
+
+/* Consumer side. Done looking at the slot returned by ring_front(), but the element stays
+   in the ring, e.g. the endpoint was busy. Lets the producer reuse it if it gets superseded. */
+void ring_keep(ring_t *ring) {
+    __dmb();
+    ring->reading = 0;
+}
+
+/* Consumer side. Time the oldest element was committed, the ring must not be empty */
+uint32_t ring_front_stamp(ring_t *ring) {
+    ring_front(ring);
+
+    uint32_t stamp = ring->stamps[ring->tail & ring->mask];
+
+    ring_keep(ring);
+    return stamp;
+}
+
+/* Producer side. Tries folding element into the newest one, as long as the consumer
+   hasn't started reading it. Returns false if it's still to be added on its own. */
+static bool ring_try_merge(ring_t *ring, const void *element) {
+    uint32_t newest = ring->head - 1;
+    bool merged     = false;
+
+    ring->merging = (newest & ring->mask) + 1;
+    __dmb();
+
+    /* Consumer may be on the slot or already done with it, then leave it alone */
+    if (ring->reading != ring->merging) {
+        __dmb();
+        if (ring->head != ring->tail)
+            merged = ring->merge(ring_slot(ring, newest), element);
+    }
+
+    /* Release: merged contents are complete before the consumer may look at the slot */
+    __dmb();
+    ring->merging = 0;
+    return merged;
+}
+
+/* Copying variants, for elements that already exist elsewhere */
+bool ring_try_add(ring_t *ring, const void *element) {
+    if (ring->policy == RING_MERGE && ring->merge && ring_try_merge(ring, element)) {
+        ring->stats.enqueued++;
+        return true;
+    }
+
+    void *slot = ring_claim(ring);
+
+    if (slot == NULL)
+        return false;
+
+    memcpy(slot, element, ring->elem_size);
+    ring_commit(ring);
+    return true;
+}
+
+bool ring_try_peek(ring_t *ring, void *element) {
+    void *slot = ring_front(ring);
+
+    if (slot == NULL)
+        return false;
+
+    memcpy(element, slot, ring->elem_size);
+    ring_keep(ring);
+    return true;
+}
+
+/* Removes the oldest element, copying it out unless element is NULL */
+bool ring_try_remove(ring_t *ring, void *element) {
+    void *slot = ring_front(ring);
+
+    if (slot == NULL)
+        return false;
+
+    if (element)
+        memcpy(element, slot, ring->elem_size);
+
+    ring_release(ring);
+    return true;
+}
+
+/* Number of elements waiting, exact on the consumer side, a lower bound elsewhere. Once
+   the producer reuses superseded slots, the counters are more than the capacity apart. */
+uint32_t ring_level(ring_t *ring) {
+    uint32_t level = ring->head - ring->tail;
+    return level > ring->mask ? ring->mask + 1u : level;
+}
+
+bool ring_is_empty(ring_t *ring) {
+    return ring->head == ring->tail;
+}
+
+/* Counters are owned by different cores, so a reset racing with an update on the other
+   side may leave that one value standing. It's telemetry, that's acceptable. */
+void ring_reset_stats(ring_t *ring) {
+    memset(&ring->stats, 0, sizeof(ring_stats_t));
+}
@@ -0,0 +1,270 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+
+#include "main.h"
+
+#ifdef DH_RING_SELFTEST
+
+#ifndef DH_DEBUG
+#error "DH_RING_SELFTEST reports over the debug CDC port, build with DH_DEBUG as well"
+#endif
+
+#include <hardware/structs/systick.h>
+#include <pico/util/queue.h>
+
+/* ================================================== *
+ * ==============  On-target Ring Tests  ============ *
+ * ================================================== *
+ *
+ * The host tests in test/ run the ring with two threads. This runs the same checks with
+ * core0 producing and core1 consuming, on the real bus and with the real barriers. It runs
+ * once at boot, before core1 is handed its actual job, and the results are printed on the
+ * debug CDC port. It also counts the cycles an add and a remove take, next to the SDK
+ * queue_t the rings replaced. That part runs on core0 alone, so it's the uncontended cost.
+ */
+
+#define SELFTEST_RING_LENGTH 16
+#define SELFTEST_ELEMENTS    100000
+#define SELFTEST_BENCH_OPS   1000
+#define SELFTEST_POLICIES    4
+
+/* Element with redundant copies of its sequence number, so a torn read shows up */
+typedef struct {
+    uint32_t seq;
+    uint32_t copies[3];
+} selftest_element_t;
+
+typedef struct {
+    const char *name;
+    uint32_t received;     // Elements the consumer got
+    uint32_t last;         // Sequence number of the last element received
+    uint32_t last_sent;    // Sequence number of the last element committed
+    uint32_t torn;         // Elements that changed while being read
+    uint32_t out_of_order; // Elements that arrived out of order, or went missing without a drop policy
+} selftest_result_t;
+
+static selftest_element_t selftest_storage[SELFTEST_RING_LENGTH];
+static uint32_t selftest_stamps[SELFTEST_RING_LENGTH];
+static ring_t selftest_ring;
+
+static selftest_result_t selftest_results[SELFTEST_POLICIES];
+static selftest_result_t *volatile selftest_current;
+static volatile bool selftest_done;     // Producer finished, written by core0
+static volatile bool selftest_finished; // Consumer drained the ring, written by core1
+
+static uint32_t ring_cycles;  // Per add and remove pair, ring_claim/commit and ring_front/release
+static uint32_t queue_cycles; // Per add and remove pair, queue_try_add/queue_try_remove
+static bool selftest_reported;
+
+static selftest_element_t make_element(uint32_t seq) {
+    return (selftest_element_t){.seq = seq, .copies = {seq, ~seq, seq * 2654435761u}};
+}
+
+static bool is_intact(const selftest_element_t *element) {
+    uint32_t seq = element->seq;
+    return element->copies[0] == seq && element->copies[1] == ~seq && element->copies[2] == seq * 2654435761u;
+}
+
+/* Elements in the same group of four supersede each other, the newest one is kept */
+static bool merge_group(void *newest, const void *element) {
+    selftest_element_t *queued     = newest;
+    const selftest_element_t *next = element;
+
+    if (queued->seq / 4 != next->seq / 4)
+        return false;
+
+    *queued = *next;
+    return true;
+}
+
+static bool loses_nothing(ring_policy_e policy) {
+    return policy == RING_DROP_NEWEST || policy == RING_MERGE;
+}
+
+/* Runs on core1 until the producer is done and the ring is drained */
+static void selftest_consumer(void) {
+    selftest_result_t *result = selftest_current;
+    bool strict               = selftest_ring.policy == RING_DROP_NEWEST;
+    uint32_t expected         = 1;
+
+    while (true) {
+        bool done = selftest_done;
+        __dmb();
+
+        selftest_element_t *element = ring_front(&selftest_ring);
+
+        if (element == NULL) {
+            if (done)
+                break;
+            continue;
+        }
+
+        if (!is_intact(element))
+            result->torn++;
+
+        if (strict ? element->seq != expected : element->seq < expected)
+            result->out_of_order++;
+
+        expected     = element->seq + 1;
+        result->last = element->seq;
+        result->received++;
+
+        ring_release(&selftest_ring);
+    }
+
+    __dmb();
+    selftest_finished = true;
+
+    while (true)
+        tight_loop_contents();
+}
+
+static void run_selftest_policy(ring_policy_e policy, const char *name, selftest_result_t *result) {
+    ring_init(&selftest_ring,
+              selftest_storage,
+              selftest_stamps,
+              sizeof(selftest_element_t),
+              SELFTEST_RING_LENGTH,
+              policy);
+    ring_set_merge(&selftest_ring, merge_group);
+
+    *result           = (selftest_result_t){.name = name};
+    selftest_current  = result;
+    selftest_done     = false;
+    selftest_finished = false;
+
+    multicore_reset_core1();
+    multicore_launch_core1(selftest_consumer);
+
+    for (uint32_t seq = 1; seq <= SELFTEST_ELEMENTS; seq++) {
+        selftest_element_t element = make_element(seq);
+        bool added;
+
+        /* Policies that never drop on their own get every element in, the others may refuse */
+        while (!(added = ring_try_add(&selftest_ring, &element)) && loses_nothing(policy))
+            tight_loop_contents();
+
+        if (added)
+            result->last_sent = seq;
+    }
+
+    __dmb();
+    selftest_done = true;
+
+    while (!selftest_finished)
+        tight_loop_contents();
+
+    multicore_reset_core1();
+}
+
+static bool selftest_passed(const selftest_result_t *result) {
+    return result->received && !result->torn && !result->out_of_order && result->last == result->last_sent;
+}
+
+/* SysTick counts down from 2^24 - 1 at the CPU clock */
+static uint32_t cycles_since(uint32_t start) {
+    return (start - systick_hw->cvr) & 0xFFFFFF;
+}
+
+static void run_selftest_bench(void) {
+    selftest_element_t element = make_element(1);
+    selftest_element_t *slot;
+    queue_t queue;
+    uint32_t start;
+
+    systick_hw->rvr = 0xFFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+
+    ring_init(&selftest_ring,
+              selftest_storage,
+              selftest_stamps,
+              sizeof(selftest_element_t),
+              SELFTEST_RING_LENGTH,
+              RING_DROP_NEWEST);
+
+    start = systick_hw->cvr;
+    for (int i = 0; i < SELFTEST_BENCH_OPS; i++) {
+        slot  = ring_claim(&selftest_ring);
+        *slot = element;
+        ring_commit(&selftest_ring);
+
+        slot    = ring_front(&selftest_ring);
+        element = *slot;
+        ring_release(&selftest_ring);
+    }
+    ring_cycles = cycles_since(start) / SELFTEST_BENCH_OPS;
+
+    queue_init(&queue, sizeof(selftest_element_t), SELFTEST_RING_LENGTH);
+
+    start = systick_hw->cvr;
+    for (int i = 0; i < SELFTEST_BENCH_OPS; i++) {
+        queue_try_add(&queue, &element);
+        queue_try_remove(&queue, &element);
+    }
+    queue_cycles = cycles_since(start) / SELFTEST_BENCH_OPS;
+
+    queue_free(&queue);
+    systick_hw->csr = 0;
+}
+
+/* Called from initial_setup() before core1 is launched for real, takes core1 over meanwhile */
+void run_ring_selftest(void) {
+    run_selftest_policy(RING_DROP_NEWEST, "drop newest", &selftest_results[0]);
+    run_selftest_policy(RING_DROP_OLDEST, "drop oldest", &selftest_results[1]);
+    run_selftest_policy(RING_SNAPSHOT, "snapshot", &selftest_results[2]);
+    run_selftest_policy(RING_MERGE, "merge", &selftest_results[3]);
+    run_selftest_bench();
+}
+
+/* Print the results once every time the debug port gets connected */
+void report_ring_selftest(void) {
+    char line[112];
+    int len;
+
+    if (!tud_cdc_connected()) {
+        selftest_reported = false;
+        return;
+    }
+
+    if (selftest_reported)
+        return;
+
+    for (int i = 0; i < SELFTEST_POLICIES; i++) {
+        const selftest_result_t *result = &selftest_results[i];
+
+        len = snprintf(line,
+                       sizeof(line),
+                       "ring %s: %s, %lu received, last %lu of %lu, %lu torn, %lu out of order\r\n",
+                       result->name,
+                       selftest_passed(result) ? "ok" : "FAILED",
+                       result->received,
+                       result->last,
+                       result->last_sent,
+                       result->torn,
+                       result->out_of_order);
+
+        tud_cdc_write(line, len);
+    }
+
+    len = snprintf(line,
+                   sizeof(line),
+                   "add + remove: ring %lu cycles, queue_t %lu cycles\r\n",
+                   ring_cycles,
+                   queue_cycles);
+
+    tud_cdc_write(line, len);
+    tud_cdc_write_flush();
+
+    selftest_reported = true;
+}
+
+#endif
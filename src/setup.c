@@ -110,9 +110,10 @@ int board_autoprobe(void) {
 /* ================================================== *
  * Configure DMA for reliable UART transfers
  * ================================================== */
-const uint8_t* uart_buffer_pointers[1] = {uart_rxbuf};
+/* RX channel is re-armed with one frame worth of bytes at a time, see configure_rx_dma() */
+static const uint32_t uart_rx_chunk_length = RAW_PACKET_LENGTH;
 uint8_t uart_rxbuf[DMA_RX_BUFFER_SIZE] __attribute__((aligned(DMA_RX_BUFFER_SIZE))) ;
-uint8_t uart_txbuf[DMA_TX_BUFFER_SIZE] __attribute__((aligned(DMA_TX_BUFFER_SIZE))) ;
+uint8_t uart_txbuf[DMA_TX_BUFFERS][DMA_TX_BUFFER_SIZE] __attribute__((aligned(DMA_TX_BUFFER_SIZE))) ;
 
 static void configure_tx_dma(device_t *state) {
     state->dma_tx_channel = dma_claim_unused_channel(true);
@@ -133,12 +134,43 @@ static void configure_tx_dma(device_t *state) {
         state->dma_tx_channel,
         &tx_config,
         &uart0_hw->dr,
-        uart_txbuf,
+        uart_txbuf[0],
         0,
         false
     );
+
+    /* Completion interrupt on core0 starts the next filled buffer right away */
+    state->tx_active = DMA_TX_IDLE;
+    dma_channel_set_irq0_enabled(state->dma_tx_channel, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, uart_tx_dma_irq_handler);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+/* Runs on core1 each time a frame worth of bytes has landed in the RX ring. The interrupt
+   itself wakes the core, we count the bytes and note the time for latency measurement.
+   Bytes are counted from the write address, so a late interrupt covering several chunks
+   still counts all of them. rx_bytes wraps much later than the ring, and together with
+   rx_consumed tells packet_receiver_task() if the DMA lapped us. */
+static void rx_dma_irq_handler(void) {
+    dma_channel_acknowledge_irq1(global_state.dma_rx_channel);
+
+    uint32_t write_addr = dma_channel_hw_addr(global_state.dma_rx_channel)->write_addr;
+    uint32_t position   = (write_addr - (uint32_t)uart_rxbuf) & (DMA_RX_BUFFER_SIZE - 1);
+
+    global_state.rx_bytes += (position - global_state.rx_bytes) & (DMA_RX_BUFFER_SIZE - 1);
+    global_state.rx_irq_us = time_us_32();
+}
+
+/* Must be called from core1, so the interrupt is routed to the core that processes packets */
+void configure_rx_irq(void) {
+    irq_set_exclusive_handler(DMA_IRQ_1, rx_dma_irq_handler);
+    irq_set_enabled(DMA_IRQ_1, true);
 }
 
+/* RX channel writes into a 1024 byte ring, but transfers only 12 bytes (one frame) at a
+   time. Once done, it chains to the control channel which writes the count again and
+   re-triggers it. Write address keeps going around the ring, and every completed chunk
+   raises an interrupt. */
 static void configure_rx_dma(device_t *state) {
     /* Find an empty channel, store it for later reference */
     state->dma_rx_channel = dma_claim_unused_channel(true);
@@ -170,17 +202,20 @@ static void configure_rx_dma(device_t *state) {
         &config,
         uart_rxbuf,
         &uart0_hw->dr,
-        DMA_RX_BUFFER_SIZE,
+        RAW_PACKET_LENGTH,
         false);
 
     dma_channel_configure(
         state->dma_control_channel,
         &control_config,
-        &dma_hw->ch[state->dma_rx_channel].al2_write_addr_trig,
-        uart_buffer_pointers,
+        &dma_hw->ch[state->dma_rx_channel].al1_transfer_count_trig,
+        &uart_rx_chunk_length,
         1,
         false);
 
+    /* Interrupt is handled on core1, see configure_rx_irq() */
+    dma_channel_set_irq1_enabled(state->dma_rx_channel, true);
+
     dma_channel_start(state->dma_control_channel);
 }
 
@@ -190,6 +225,28 @@ static void configure_rx_dma(device_t *state) {
  * ================================================== */
 int board;
 
+/* Backing storage for the SPSC queues and their enqueue timestamps, sizes must be powers of two */
+static hid_keyboard_report_t kbd_queue_storage[KBD_QUEUE_LENGTH];
+static mouse_report_t mouse_queue_storage[MOUSE_QUEUE_LENGTH];
+static hid_generic_pkt_t hid_queue_storage[HID_QUEUE_LENGTH];
+static hid_generic_pkt_t vendor_queue_storage[VENDOR_QUEUE_LENGTH];
+static hid_generic_pkt_t set_report_queue_storage[SET_REPORT_QUEUE_LENGTH];
+static uart_packet_t uart_tx_input_storage[UART_QUEUE_LENGTH];
+static uart_packet_t uart_tx_control_storage[UART_QUEUE_LENGTH];
+static uart_packet_t uart_tx_bulk_storage[UART_BULK_QUEUE_LENGTH];
+
+static uint32_t kbd_queue_stamps[KBD_QUEUE_LENGTH];
+static uint32_t mouse_queue_stamps[MOUSE_QUEUE_LENGTH];
+static uint32_t hid_queue_stamps[HID_QUEUE_LENGTH];
+static uint32_t vendor_queue_stamps[VENDOR_QUEUE_LENGTH];
+static uint32_t set_report_queue_stamps[SET_REPORT_QUEUE_LENGTH];
+static uint32_t uart_tx_input_stamps[UART_QUEUE_LENGTH];
+static uint32_t uart_tx_control_stamps[UART_QUEUE_LENGTH];
+static uint32_t uart_tx_bulk_stamps[UART_BULK_QUEUE_LENGTH];
+
+static uint16_t link_ack_queue_storage[LINK_ACK_QUEUE_LENGTH];
+static uint32_t link_ack_queue_stamps[LINK_ACK_QUEUE_LENGTH];
+
 void initial_setup(device_t *state) {
     /* PIO USB requires a clock multiple of 12 MHz, setting to 120 MHz */
     set_sys_clock_khz(120000, true);
@@ -210,19 +267,93 @@ void initial_setup(device_t *state) {
     serial_init();
 
     /* Initialize keyboard and mouse queues */
-    queue_init(&state->kbd_queue, sizeof(hid_keyboard_report_t), KBD_QUEUE_LENGTH);
-    queue_init(&state->mouse_queue, sizeof(mouse_report_t), MOUSE_QUEUE_LENGTH);
-
-    /* Initialize generic HID packet queue */
-    queue_init(&state->hid_queue_out, sizeof(hid_generic_pkt_t), HID_QUEUE_LENGTH);
-
-    /* Initialize UART queue */
-    queue_init(&state->uart_tx_queue, sizeof(uart_packet_t), UART_QUEUE_LENGTH);
+    ring_init(&state->kbd_queue,
+              kbd_queue_storage,
+              kbd_queue_stamps,
+              sizeof(hid_keyboard_report_t),
+              KBD_QUEUE_LENGTH,
+              RING_SNAPSHOT);
+    ring_init(&state->mouse_queue,
+              mouse_queue_storage,
+              mouse_queue_stamps,
+              sizeof(mouse_report_t),
+              MOUSE_QUEUE_LENGTH,
+              RING_MERGE);
+    ring_set_merge(&state->mouse_queue, merge_mouse_report);
+    critical_section_init(&state->mouse_lock);
+
+    /* Initialize generic HID packet queues and the set report hand-over queue */
+    ring_init(&state->hid_queue_out,
+              hid_queue_storage,
+              hid_queue_stamps,
+              sizeof(hid_generic_pkt_t),
+              HID_QUEUE_LENGTH,
+              RING_DROP_OLDEST);
+
+    /* Reading all values answers with one reply per API field, needs to fit them all */
+    ring_init(&state->vendor_queue,
+              vendor_queue_storage,
+              vendor_queue_stamps,
+              sizeof(hid_generic_pkt_t),
+              VENDOR_QUEUE_LENGTH,
+              RING_DROP_NEWEST);
+    ring_init(&state->set_report_queue,
+              set_report_queue_storage,
+              set_report_queue_stamps,
+              sizeof(hid_generic_pkt_t),
+              SET_REPORT_QUEUE_LENGTH,
+              RING_DROP_OLDEST);
+
+    /* Initialize UART queues. Input favors fresh packets. Control carries state changes that
+       mustn't be dropped silently, send_value() retries those, and a config answer is no good
+       with holes in it */
+    ring_init(&state->uart_tx_queue[UART_LANE_INPUT],
+              uart_tx_input_storage,
+              uart_tx_input_stamps,
+              sizeof(uart_packet_t),
+              UART_QUEUE_LENGTH,
+              RING_DROP_OLDEST);
+
+    ring_init(&state->uart_tx_queue[UART_LANE_CONTROL],
+              uart_tx_control_storage,
+              uart_tx_control_stamps,
+              sizeof(uart_packet_t),
+              UART_QUEUE_LENGTH,
+              RING_DROP_NEWEST);
+
+    ring_init(&state->uart_tx_queue[UART_LANE_BULK],
+              uart_tx_bulk_storage,
+              uart_tx_bulk_stamps,
+              sizeof(uart_packet_t),
+              UART_BULK_QUEUE_LENGTH,
+              RING_DROP_NEWEST);
+
+    /* ACKs for reliable link packets, a lost one only causes a retransmission */
+    ring_init(&state->link_ack_queue,
+              link_ack_queue_storage,
+              link_ack_queue_stamps,
+              sizeof(uint16_t),
+              LINK_ACK_QUEUE_LENGTH,
+              RING_DROP_NEWEST);
+
+    /* Start with legacy framing at the boot baud rate, until the other board's caps arrive */
+    state->link_speed.ceiling_idx = LINK_BAUDRATE_COUNT - 1;
+    reset_link_caps(state);
+    reset_link_speed(state);
 
     /* >>> NEW: default to gaming mode ON at boot, and sync peer over UART <<< */
     state->gaming_mode = 1;
     send_value(state->gaming_mode, GAMING_MODE_MSG);
 
+    /* A is the default output. This writes the UART control lane and the keyboard queue,
+       which core1 fills once it runs, so it has to happen before core1 is launched. */
+    set_active_output(state, OUTPUT_A);
+
+#ifdef DH_RING_SELFTEST
+    /* Borrows core1 for a while, before it gets its real job */
+    run_ring_selftest();
+#endif
+
     /* Setup RP2040 Core 1 */
     multicore_reset_core1();
     multicore_launch_core1(core1_main);
@@ -0,0 +1,217 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+
+#include "main.h"
+
+/* ================================================== *
+ * ==============  Report Rate Meter  =============== *
+ * ================================================== */
+
+void reset_report_rate(report_rate_t *rate) {
+    memset(rate, 0, sizeof(report_rate_t));
+}
+
+/* Log-linear histogram bin of an interval, the top bits of the interval pick the power of two
+   and the next REPORT_RATE_SUB_BITS bits the bin within it */
+static uint32_t interval_bin(uint32_t interval) {
+    uint32_t units = interval / REPORT_RATE_UNIT_US;
+
+    if (interval >= REPORT_RATE_MAX_US)
+        return REPORT_RATE_BINS - 1;
+
+    if (units < REPORT_RATE_SUB_BINS)
+        return units;
+
+    uint32_t exponent = 31 - __builtin_clz(units);
+    uint32_t sub_bin  = (units >> (exponent - REPORT_RATE_SUB_BITS)) & (REPORT_RATE_SUB_BINS - 1);
+
+    return (exponent - REPORT_RATE_SUB_BITS + 1) * REPORT_RATE_SUB_BINS + sub_bin;
+}
+
+/* Lower edge of a histogram bin in microseconds, the reverse of interval_bin() */
+static uint32_t bin_start_us(uint32_t bin) {
+    if (bin < REPORT_RATE_SUB_BINS)
+        return bin * REPORT_RATE_UNIT_US;
+
+    uint32_t exponent = bin / REPORT_RATE_SUB_BINS + REPORT_RATE_SUB_BITS - 1;
+    uint32_t mantissa = REPORT_RATE_SUB_BINS + bin % REPORT_RATE_SUB_BINS;
+
+    return (mantissa << (exponent - REPORT_RATE_SUB_BITS)) * REPORT_RATE_UNIT_US;
+}
+
+/* Called from the report received callback, before we do anything with the report */
+void record_report_arrival(report_rate_t *rate, uint32_t now) {
+    uint32_t interval = now - rate->last_report_us;
+
+    rate->last_report_us = now;
+
+    /* The first report and reports after an idle pause carry no timing information */
+    if (rate->reports++ == 0 || interval > REPORT_RATE_IDLE_US)
+        return;
+
+    /* Seed the average with the first real interval, then follow it slowly */
+    if (rate->avg_interval_us == 0)
+        rate->avg_interval_us = interval;
+
+    if (interval > 2 * rate->avg_interval_us)
+        rate->gaps++;
+
+    rate->avg_interval_us += ((int32_t)interval - (int32_t)rate->avg_interval_us) / 16;
+
+    if (interval > rate->max_interval_us)
+        rate->max_interval_us = interval;
+
+    uint32_t bin = interval_bin(interval);
+
+    /* Keep the histogram from saturating by halving it, older samples weigh less */
+    if (++rate->histogram[bin] == UINT16_MAX)
+        for (int i = 0; i < REPORT_RATE_BINS; i++)
+            rate->histogram[i] >>= 1;
+}
+
+/* Called when we're done processing the report, to see what our pipeline adds */
+void record_report_processed(report_rate_t *rate, uint32_t now) {
+    uint32_t duration = now - rate->last_report_us;
+
+    if (duration > rate->max_process_us)
+        rate->max_process_us = duration;
+}
+
+/* Upper edge of the bin where the cumulative count reaches given percentage. The overflow bin
+   has no upper edge, so it's reported as REPORT_RATE_OVERFLOW instead of a made up value. */
+static uint16_t histogram_percentile(const report_rate_t *rate, uint32_t percent) {
+    uint32_t total = 0, count = 0;
+
+    for (int i = 0; i < REPORT_RATE_BINS; i++)
+        total += rate->histogram[i];
+
+    for (int i = 0; i < REPORT_RATE_BINS; i++) {
+        count += rate->histogram[i];
+
+        if (!total || count * 100 < total * percent)
+            continue;
+
+        return (i == REPORT_RATE_BINS - 1) ? REPORT_RATE_OVERFLOW : bin_start_us(i + 1);
+    }
+
+    return 0;
+}
+
+static void summarize_report_rate(const report_rate_t *rate, report_rate_view_t *view) {
+    view->rate_hz    = rate->avg_interval_us ? 1000000 / rate->avg_interval_us : 0;
+    view->p50_us     = histogram_percentile(rate, 50);
+    view->p99_us     = histogram_percentile(rate, 99);
+    view->max_us     = rate->max_interval_us;
+    view->gaps       = rate->gaps;
+    view->process_us = rate->max_process_us;
+}
+
+#ifdef DH_DEBUG
+/* Dump all active interfaces to the debug serial port */
+static void print_report_rates(device_t *state) {
+    char line[112];
+
+    if (!tud_cdc_connected())
+        return;
+
+    for (int i = 0; i < MAX_DEVICES * MAX_INTERFACES; i++) {
+        const report_rate_t *rate = &state->report_rate[0][0] + i;
+        report_rate_view_t view;
+
+        if (rate->reports == 0)
+            continue;
+
+        summarize_report_rate(rate, &view);
+
+        int len = snprintf(line,
+                           sizeof(line),
+                           "iface %d: %u Hz, p50 %u us, p99 %u us, max %lu us, gaps %lu, proc %lu us\r\n",
+                           i,
+                           view.rate_hz,
+                           view.p50_us,
+                           view.p99_us,
+                           view.max_us,
+                           view.gaps,
+                           view.process_us);
+
+        tud_cdc_write(line, len);
+    }
+
+    tud_cdc_write_flush();
+}
+#endif
+
+/* ================================================== *
+ * ===============  Queue Telemetry  ================ *
+ * ================================================== */
+
+static ring_t *stat_queues(device_t *state, int i) {
+    ring_t *queues[] = {
+        &state->kbd_queue,
+        &state->mouse_queue,
+        &state->hid_queue_out,
+        &state->uart_tx_queue[UART_LANE_INPUT],
+        &state->uart_tx_queue[UART_LANE_CONTROL],
+        &state->uart_tx_queue[UART_LANE_BULK],
+        &state->set_report_queue,
+        &state->vendor_queue,
+    };
+
+    return i < ARRAY_SIZE(queues) ? queues[i] : NULL;
+}
+
+void reset_stats(device_t *state) {
+    ring_t *queue;
+
+    for (int i = 0; (queue = stat_queues(state, i)) != NULL; i++)
+        ring_reset_stats(queue);
+
+    for (int i = 0; i < MAX_DEVICES * MAX_INTERFACES; i++)
+        reset_report_rate(&state->report_rate[0][0] + i);
+
+    state->rx_backlog_max    = 0;
+    state->rx_latency_max_us = 0;
+    state->link_retransmits  = 0;
+    state->link_duplicates   = 0;
+    state->link_lost         = 0;
+    state->link_rx_errors    = 0;
+
+    state->link_checksum_errors = 0;
+    state->link_discarded       = 0;
+    state->link_unknown_types   = 0;
+    state->link_overruns        = 0;
+
+    state->kbd_sync_rx.gaps      = 0;
+    state->link_clock.rtt_max_us = 0;
+    state->link_clock.rtt_spikes = 0;
+}
+
+/* Periodically refresh the summaries exposed over the API */
+void stats_task(device_t *state) {
+    report_rate_view_t *view = &state->report_rate_view;
+    ring_t *queue;
+
+    if (view->iface >= MAX_DEVICES * MAX_INTERFACES)
+        view->iface = 0;
+
+    summarize_report_rate(&state->report_rate[0][0] + view->iface, view);
+
+    for (int i = 0; (queue = stat_queues(state, i)) != NULL; i++)
+        queue->stats.depth = ring_level(queue);
+
+#ifdef DH_DEBUG
+    print_report_rates(state);
+#endif
+
+#ifdef DH_RING_SELFTEST
+    report_ring_selftest();
+#endif
+}
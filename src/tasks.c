@@ -64,56 +64,237 @@ void heartbeat_output_task(device_t *state) {
         reset_usb_boot(1 << PICO_DEFAULT_LED_PIN, 0);
 #endif
 
-    uart_packet_t packet = {
+    /* Other board went quiet, don't assume it still understands what it did before */
+    check_link_peer(state);
+
+    ring_t *lane          = &state->uart_tx_queue[UART_LANE_CONTROL];
+    uart_packet_t *packet = ring_claim(lane);
+
+    if (packet == NULL)
+        return;
+
+    /* Heartbeat is also a ping, the other board answers so we can track RTT and clock offset.
+       The token and send time are filled in when it's packed for sending. */
+    *packet = (uart_packet_t){
         .type = HEARTBEAT_MSG,
         .data16 = {
-            [0] = state->_running_fw.version,
+            [LINK_PEER_VERSION_IDX] = state->_running_fw.version,
             [2] = state->active_output,
         },
     };
 
-    queue_try_add(&global_state.uart_tx_queue, &packet);
+    state->link_clock.ping_pending = true;
+
+    ring_commit(lane);
+
+    /* Advertise the link features we support */
+    send_link_caps(state);
+}
+
+
+/* State changes that didn't fit into their lane earlier, send_value() clears them once queued */
+void resend_values_task(device_t *state) {
+    uint32_t pending = state->deferred_mask;
+
+    for (int type = 0; pending; type++, pending >>= 1)
+        if (pending & 1)
+            send_value(state->deferred_values[type], type);
+}
+
+/* ================================================== *
+ * =============  Outbound HID Scheduler  =========== *
+ * ================================================== *
+ *
+ * Everything we send to the computer goes through one scheduler. Each lane is a queue
+ * in FIFO order, so order within a source always holds. Lanes are numbered in priority
+ * order: the pending and ready lanes form a bitmask, and the lowest set bit is sent next.
+ * Keyboard and consumer/system control share an endpoint. When both are waiting, the
+ * one queued first goes first, so a keypress and a media key keep their order.
+ */
+
+enum outbound_lane_e {
+    LANE_KEYBOARD = 0,
+    LANE_MOUSE    = 1,
+    LANE_CONTROL  = 2,
+    LANE_VENDOR   = 3,
+};
+
+#define LANE(lane)    (1 << (lane))
+#define HID_ITF_LANES (LANE(LANE_KEYBOARD) | LANE(LANE_CONTROL))
+
+static bool send_queued_control_packet(device_t *state) {
+    return send_queued_hid_packet(&state->hid_queue_out);
+}
+
+static bool send_queued_vendor_packet(device_t *state) {
+    return send_queued_hid_packet(&state->vendor_queue);
 }
 
+typedef struct {
+    uint8_t instance;         // HID interface the lane sends to
+    uint8_t endpoint_lanes;   // All lanes sharing that interface, including this one
+    bool (*send)(device_t *); // Sends the next element, returns true on success
+} outbound_lane_t;
+
+static const outbound_lane_t outbound_lanes[] = {
+    [LANE_KEYBOARD] = {ITF_NUM_HID,        HID_ITF_LANES,     send_queued_kbd_report},
+    [LANE_MOUSE]    = {ITF_NUM_HID_REL_M,  LANE(LANE_MOUSE),  send_queued_mouse_report},
+    [LANE_CONTROL]  = {ITF_NUM_HID,        HID_ITF_LANES,     send_queued_control_packet},
+    [LANE_VENDOR]   = {ITF_NUM_HID_VENDOR, LANE(LANE_VENDOR), send_queued_vendor_packet},
+};
+
+static uint32_t outbound_pending(device_t *state) {
+    uint32_t pending = 0;
+
+    if (!ring_is_empty(&state->kbd_queue))
+        pending |= LANE(LANE_KEYBOARD);
+
+    if (!ring_is_empty(&state->mouse_queue) || state->mouse_acc.pending)
+        pending |= LANE(LANE_MOUSE);
+
+    if (!ring_is_empty(&state->hid_queue_out))
+        pending |= LANE(LANE_CONTROL);
+
+    if (!ring_is_empty(&state->vendor_queue))
+        pending |= LANE(LANE_VENDOR);
+
+    return pending;
+}
+
+/* Lowest set bit is the highest priority lane, except keyboard vs. control where age decides */
+static int next_lane(device_t *state, uint32_t sendable) {
+    int lane = __builtin_ctz(sendable);
+
+    /* Both are pending, so neither queue is empty */
+    if (lane == LANE_KEYBOARD && (sendable & LANE(LANE_CONTROL))
+        && (int32_t)(ring_front_stamp(&state->hid_queue_out) - ring_front_stamp(&state->kbd_queue)) < 0)
+        lane = LANE_CONTROL;
 
-/* Process other outgoing hid report messages. */
-void process_hid_queue_task(device_t *state) {
-    hid_generic_pkt_t packet;
+    return lane;
+}
 
+void process_outbound_task(device_t *state) {
     /* If NULL MODE is active, don't send any HID reports */
     if (state->null_mode)
         return;
 
-    if (!queue_try_peek(&state->hid_queue_out, &packet))
+    /* If we're not connected, we have nowhere to send reports to. */
+    if (!state->tud_connected)
+        return;
+
+    uint32_t pending = outbound_pending(state);
+
+    if (!pending)
         return;
 
-    if (!tud_hid_n_ready(packet.instance))
+    /* If we are suspended and have input for the host, let's wake it up */
+    if (tud_suspended()) {
+        if (pending & (LANE(LANE_KEYBOARD) | LANE(LANE_MOUSE)))
+            tud_remote_wakeup();
         return;
+    }
+
+    uint32_t sendable = 0;
 
-    /* ... try sending it to the host, if it's successful */
-    bool succeeded = tud_hid_n_report(packet.instance, packet.report_id, packet.data, packet.len);
+    for (int lane = 0; lane < ARRAY_SIZE(outbound_lanes); lane++)
+        if ((pending & LANE(lane)) && tud_hid_n_ready(outbound_lanes[lane].instance))
+            sendable |= LANE(lane);
 
-    /* ... then we can remove it from the queue. Race conditions shouldn't happen [tm] */
-    if (succeeded)
-        queue_try_remove(&state->hid_queue_out, &packet);
+    /* Every ready endpoint gets one report per pass, after that it's busy until it completes */
+    while (sendable) {
+        int lane = next_lane(state, sendable);
+
+        outbound_lanes[lane].send(state);
+        sendable &= ~outbound_lanes[lane].endpoint_lanes;
+    }
 }
 
 
 void packet_receiver_task(device_t *state) {
-    uint32_t current_pointer
-        = (uint32_t)DMA_RX_BUFFER_SIZE - dma_channel_hw_addr(state->dma_rx_channel)->transfer_count;
-    uint32_t delta = get_ptr_delta(current_pointer, state);
+    /* Read before the write address, so it's never ahead of it */
+    uint32_t rx_bytes = state->rx_bytes;
+
+    /* DMA transfers in frame sized chunks, so the write address tells where it really is */
+    uint32_t write_addr      = dma_channel_hw_addr(state->dma_rx_channel)->write_addr;
+    uint32_t current_pointer = (write_addr - (uint32_t)uart_rxbuf) & (DMA_RX_BUFFER_SIZE - 1);
+    uint32_t delta           = get_ptr_delta(current_pointer, state);
+    uint32_t started         = time_us_32();
+    int budget               = RX_PACKET_BUDGET;
+
+    /* Bytes received so far, rx_bytes brought up to the write address */
+    uint32_t received = rx_bytes + ((current_pointer - rx_bytes) & (DMA_RX_BUFFER_SIZE - 1));
+
+    /* A full ring or more is waiting, so the DMA wrote over bytes we hadn't read. The ring
+       positions can't show that, whatever is left there is garbage, start over from here. */
+    if (received - state->rx_consumed >= DMA_RX_BUFFER_SIZE) {
+        state->link_overruns++;
+        state->link_discarded += received - state->rx_consumed;
+        state->dma_ptr     = current_pointer;
+        state->rx_consumed = received;
+        delta              = 0;
+    }
+
+    /* If a frame landed since the last pass, measure how long it took us to get here */
+    if (rx_bytes != state->rx_bytes_seen) {
+        uint32_t latency = started - state->rx_irq_us;
+
+        if (latency > state->rx_latency_max_us)
+            state->rx_latency_max_us = latency;
+
+        state->rx_bytes_seen = rx_bytes;
+    }
+
+    if (delta > state->rx_backlog_max)
+        state->rx_backlog_max = delta;
+
+    /* Legacy frames start with the preamble, anything else is treated as a COBS frame */
+    while (delta > 0) {
+        bool valid = false;
 
-    /* If we don't have enough characters for a packet, skip loop and return immediately */
-    while (delta >= RAW_PACKET_LENGTH) {
         if (is_start_of_packet(state)) {
+            /* If we don't have enough characters for a packet, return and wait for the rest */
+            if (delta < RAW_PACKET_LENGTH)
+                return;
+
             fetch_packet(state);
-            process_packet(&state->in_packet, state);
-            return;
+            delta -= RAW_PACKET_LENGTH;
+            valid              = verify_checksum(&state->in_packet);
+            state->in_reliable = false;
+
+            if (!valid)
+                state->link_checksum_errors++;
+        } else {
+            uint32_t consumed = fetch_cobs_packet(state, delta, &valid);
+
+            /* Frame isn't complete yet */
+            if (consumed == 0)
+                return;
+
+            /* Skip the frame, or the garbage up to where the next one might start */
+            consume_rx_bytes(state, consumed);
+            delta -= consumed;
+
+            if (!valid)
+                state->link_discarded += consumed;
+        }
+
+        if (!valid)
+            continue;
+
+        /* Intact, but not something we know, probably newer firmware on the other board */
+        if (get_message(state->in_packet.type) == NULL) {
+            state->link_unknown_types++;
+            continue;
         }
 
-        /* No packet found, advance to next position and decrement delta */
-        state->dma_ptr = NEXT_RING_IDX(state->dma_ptr);
-        delta--;
+        /* ACKs and duplicate reliable packets stop here */
+        if (!accept_link_packet(state))
+            continue;
+
+        process_packet(&state->in_packet, state);
+
+        /* Leave the rest for the next pass, so a flood can't starve the USB host */
+        if (--budget == 0 || time_us_32() - started >= RX_TIME_BUDGET_US)
+            return;
     }
 }
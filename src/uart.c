@@ -27,72 +27,188 @@ void write_raw_packet(uint8_t *dst, uart_packet_t *packet) {
     memcpy(dst, &pkt, RAW_PACKET_LENGTH);
 }
 
-/* Schedule packet for sending to the other box */
-void queue_packet(const uint8_t *data, enum packet_type_e packet_type, int length) {
-    uart_packet_t packet = {.type = packet_type};
-    memcpy(packet.data, data, length);
+/* Which TX lane a packet type goes to, so config traffic never delays a keystroke */
+static enum uart_lane_e get_uart_lane(enum packet_type_e packet_type) {
+    const message_t *message = get_message(packet_type);
+    return message ? message->lane : UART_LANE_BULK;
+}
+
+/* Schedule packet for sending to the other box, returns false if its lane is full */
+bool queue_packet(const uint8_t *data, enum packet_type_e packet_type, int length) {
+    ring_t *lane          = &global_state.uart_tx_queue[get_uart_lane(packet_type)];
+    uart_packet_t *packet = ring_claim(lane);
+
+    if (packet == NULL)
+        return false;
 
-    queue_try_add(&global_state.uart_tx_queue, &packet);
+    packet->type = packet_type;
+    memcpy(packet->data, data, length);
+    memset(packet->data + length, 0, PACKET_DATA_LENGTH - length);
+
+    ring_commit(lane);
+    return true;
 }
 
-/* Sends just one byte of a certain packet type to the other box. */
+/* Sends just one byte of a certain packet type to the other box. These carry state (output,
+   LEDs, gaming mode), so if the lane is full the value is kept, only the newest one per type,
+   and resend_values_task() tries again. Runs on core1 like the task, or before it starts. */
 void send_value(const uint8_t value, enum packet_type_e packet_type) {
-    queue_packet(&value, packet_type, sizeof(uint8_t));
+    device_t *state = &global_state;
+    uint32_t bit    = 1u << packet_type;
+
+    /* A newer value made it, an older one still waiting is stale now */
+    if (queue_packet(&value, packet_type, sizeof(uint8_t))) {
+        state->deferred_mask &= ~bit;
+        return;
+    }
+
+    state->deferred_values[packet_type] = value;
+    state->deferred_mask |= bit;
+}
+
+/* ================================================== *
+ * ================  Transmit Pipeline  ============= *
+ * ================================================== *
+ *
+ * Two TX buffers take turns. While DMA sends one, the task packs as many queued
+ * packets as fit into the other. The DMA completion interrupt starts the other buffer
+ * right away if it's ready, so a burst goes out back to back without gaps.
+ */
+
+static void start_tx_buffer(device_t *state, uint8_t buf) {
+    state->tx_active = buf;
+    dma_channel_transfer_from_buffer_now(state->dma_tx_channel, uart_txbuf[buf], state->tx_len[buf]);
+}
+
+/* Runs on core0 when a TX buffer has been sent */
+void uart_tx_dma_irq_handler(void) {
+    device_t *state = &global_state;
+    uint8_t done    = state->tx_active;
+
+    dma_channel_acknowledge_irq0(state->dma_tx_channel);
+
+    if (done == DMA_TX_IDLE)
+        return;
+
+    state->tx_len[done] = 0;
+    state->tx_active    = DMA_TX_IDLE;
+
+    /* The other buffer was filled in the meantime, keep the wire busy */
+    if (state->tx_len[done ^ 1])
+        start_tx_buffer(state, done ^ 1);
 }
 
-/* Process outgoing config report messages. */
+/* Rate change asked for by the link speed task on core1. Nothing new is packed while it's
+   pending, once DMA is done and the UART has shifted out its last bit, we switch. Returns
+   true while the switch still waits for that. */
+static bool switch_link_baudrate(device_t *state) {
+    uint32_t baudrate = state->link_baud_request;
+
+    if (!baudrate)
+        return false;
+
+    if (state->tx_active != DMA_TX_IDLE || uart_get_hw(SERIAL_UART)->fr & UART_UARTFR_BUSY_BITS)
+        return true;
+
+    state->link_baudrate     = uart_set_baudrate(SERIAL_UART, baudrate);
+    state->link_baud_request = 0;
+    return false;
+}
+
+/* Pick the lane to send from next: highest priority first, but a bulk packet that waited
+   too long gets one slot per buffer, so a constant stream of input can't starve it */
+static ring_t *next_uart_lane(device_t *state, bool *guard_used) {
+    ring_t *bulk  = &state->uart_tx_queue[UART_LANE_BULK];
+    bool starving = !ring_is_empty(bulk) && time_us_32() - ring_front_stamp(bulk) > UART_BULK_MAX_WAIT_US;
+
+    if (starving && !*guard_used) {
+        *guard_used = true;
+        return bulk;
+    }
+
+    for (int lane = 0; lane < UART_LANES; lane++)
+        if (!ring_is_empty(&state->uart_tx_queue[lane]))
+            return &state->uart_tx_queue[lane];
+
+    return NULL;
+}
+
+/* Process outgoing packets, pack them into a free TX buffer and hand it to DMA. */
 void process_uart_tx_task(device_t *state) {
-    uart_packet_t packet = {0};
+    uint8_t fill    = state->tx_fill;
+    uint16_t len    = 0;
+    bool guard_used = false;
+    uart_packet_t *packet;
+    ring_t *lane;
+
+    /* Let the frames in flight finish at the old rate before switching */
+    if (switch_link_baudrate(state))
+        return;
 
-    if (dma_channel_is_busy(state->dma_tx_channel))
+    /* Both buffers are busy, we'll catch up once DMA finishes one */
+    if (state->tx_len[fill])
         return;
 
-    if (!queue_try_remove(&state->uart_tx_queue, &packet))
+    /* Overdue reliable packets go first, then new ones straight from the queue slots */
+    process_link_acks(state);
+    len = retransmit_link_packets(state, uart_txbuf[fill], DMA_TX_BUFFER_SIZE);
+
+    while (len + LINK_MAX_FRAME <= DMA_TX_BUFFER_SIZE
+           && (lane = next_uart_lane(state, &guard_used)) != NULL) {
+        if ((packet = ring_front(lane)) == NULL)
+            break;
+
+        len += write_link_frame(&uart_txbuf[fill][len], packet, state);
+        ring_release(lane);
+    }
+
+    if (!len)
         return;
 
-    write_raw_packet(uart_txbuf, &packet);
-    dma_channel_transfer_from_buffer_now(state->dma_tx_channel, uart_txbuf, RAW_PACKET_LENGTH);
+    /* Completion interrupt looks at the same fields, keep it out while we hand over */
+    uint32_t ints = save_and_disable_interrupts();
+
+    state->tx_len[fill] = len;
+    state->tx_fill      = fill ^ 1;
+
+    if (state->tx_active == DMA_TX_IDLE)
+        start_tx_buffer(state, fill);
+
+    restore_interrupts(ints);
 }
 
 /* ================================================== *
  * ===============  Parsing Packets  ================ *
  * ================================================== */
 
-const uart_handler_t uart_handler[] = {
-    /* Core functions */
-    {.type = KEYBOARD_REPORT_MSG, .handler = handle_keyboard_uart_msg},
-    {.type = MOUSE_REPORT_MSG, .handler = handle_mouse_abs_uart_msg},
-    {.type = OUTPUT_SELECT_MSG, .handler = handle_output_select_msg},
-
-    /* Box control */
-    {.type = KBD_SET_REPORT_MSG, .handler = handle_set_report_msg},
-    {.type = FLASH_LED_MSG, .handler = handle_flash_led_msg},
-    {.type = GAMING_MODE_MSG, .handler = handle_toggle_gaming_msg},
-    {.type = CONSUMER_CONTROL_MSG, .handler = handle_consumer_control_msg},
-    {.type = SYSTEM_CONTROL_MSG, .handler = handle_system_control_msg},
-
-    /* Config */
-    {.type = WIPE_CONFIG_MSG, .handler = handle_wipe_config_msg},
-    {.type = SAVE_CONFIG_MSG, .handler = handle_save_config_msg},
-    {.type = REBOOT_MSG, .handler = handle_reboot_msg},
-    {.type = GET_VAL_MSG, .handler = handle_api_msgs},
-    {.type = GET_ALL_VALS_MSG, .handler = handle_api_read_all_msg},
-    {.type = SET_VAL_MSG, .handler = handle_api_msgs},
-
-    /* Firmware */
-
-    {.type = HEARTBEAT_MSG, .handler = handle_heartbeat_msg},
-    {.type = PROXY_PACKET_MSG, .handler = handle_proxy_msg},
-};
+/* Indexed by message type, generated from MESSAGE_REGISTRY in protocol.h */
+#define MESSAGE_ENTRY(name, id, handler_fn, max_length, tx_lane, host, reliable_class) \
+    [id] = {.handler    = handler_fn,                                              \
+            .length     = max_length,                                              \
+            .lane       = UART_LANE_##tx_lane,                                     \
+            .from_host  = host,                                                    \
+            .reliable   = reliable_class,                                          \
+            .registered = true},
+
+const message_t message_registry[] = {MESSAGE_REGISTRY(MESSAGE_ENTRY)};
+
+/* Duplicate detection for reliable packets keeps a slot per message type */
+_Static_assert(ARRAY_SIZE(message_registry) <= LINK_RX_TYPES, "LINK_RX_TYPES too small");
+
+/* Returns what we know about a message type, or NULL if it's not one of ours */
+const message_t *get_message(uint8_t type) {
+    if (type >= ARRAY_SIZE(message_registry) || !message_registry[type].registered)
+        return NULL;
+
+    return &message_registry[type];
+}
 
 void process_packet(uart_packet_t *packet, device_t *state) {
     if (!verify_checksum(packet))
         return;
 
-    for (int i = 0; i < ARRAY_SIZE(uart_handler); i++) {
-        if (uart_handler[i].type == packet->type) {
-            uart_handler[i].handler(packet, state);
-            return;
-        }
-    }
+    const message_t *message = get_message(packet->type);
+
+    if (message != NULL && message->handler != NULL)
+        message->handler(packet, state);
 }
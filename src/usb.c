@@ -32,6 +32,10 @@ uint16_t tud_hid_get_report_cb(uint8_t instance,
  * USB_REQ_TYP_CLASS | USB_REQ_REC_IFACE) Request code for SetReport is 0x09,
  * report type is 0x02 (HID_REPORT_TYPE_OUTPUT). We get a set_report callback
  * from TinyUSB device HID and then figure out what to do with the LEDs.
+ *
+ * This runs on core0, but everything else that produces outgoing packets runs on
+ * core1. To keep all queues single-producer, the report is only copied here and
+ * handed over to core1, which processes it in process_set_report_task().
  */
 void tud_hid_set_report_cb(uint8_t instance,
                            uint8_t report_id,
@@ -39,46 +43,75 @@ void tud_hid_set_report_cb(uint8_t instance,
                            uint8_t const *buffer,
                            uint16_t bufsize) {
 
+    /* We insist on a fixed size packet for config, LEDs are exactly 1 byte long */
+    if (bufsize > RAW_PACKET_LENGTH)
+        return;
+
+    hid_generic_pkt_t *report = ring_claim(&global_state.set_report_queue);
+
+    if (report == NULL)
+        return;
+
+    report->instance  = instance;
+    report->report_id = report_id;
+    report->type      = report_type;
+    report->len       = bufsize;
+
+    memcpy(report->data, buffer, bufsize);
+    ring_commit(&global_state.set_report_queue);
+}
+
+static void handle_set_report(hid_generic_pkt_t *report, device_t *state) {
     /* We received a report on the config report ID */
-    if (instance == ITF_NUM_HID_VENDOR && report_id == REPORT_ID_VENDOR) {
+    if (report->instance == ITF_NUM_HID_VENDOR && report->report_id == REPORT_ID_VENDOR) {
 
         /* We insist on a fixed size packet. No overflows. */
-        if (bufsize != RAW_PACKET_LENGTH)
+        if (report->len != RAW_PACKET_LENGTH)
             return;
 
-        uart_packet_t *packet = (uart_packet_t *) (buffer + START_LENGTH);
+        uart_packet_t *packet = (uart_packet_t *) (report->data + START_LENGTH);
 
         /* Only a certain packet types are accepted */
         if (!validate_packet(packet))
             return;
 
-        process_packet(packet, &global_state);
+        process_packet(packet, state);
     }
 
     /* Only other set report we care about is LED state change, and that's exactly 1 byte long */
-    if (report_id != REPORT_ID_KEYBOARD || bufsize != 1 || report_type != HID_REPORT_TYPE_OUTPUT)
+    if (report->report_id != REPORT_ID_KEYBOARD || report->len != 1 || report->type != HID_REPORT_TYPE_OUTPUT)
         return;
 
-    uint8_t leds = buffer[0];
+    uint8_t leds = report->data[0];
 
     /* If we are using caps lock LED to indicate the chosen output, that has priority */
-    if (global_state.config.kbd_led_as_indicator) {
+    if (state->config.kbd_led_as_indicator) {
         leds = leds & 0xFD; /* 1111 1101 (Clear Caps Lock bit) */
 
-        if (global_state.active_output)
+        if (state->active_output)
             leds |= KEYBOARD_LED_CAPSLOCK;
     }
 
-    global_state.keyboard_leds[BOARD_ROLE] = leds;
+    state->keyboard_leds[BOARD_ROLE] = leds;
 
     /* If the board has a keyboard connected directly, restore those leds. */
-    if (global_state.keyboard_connected && CURRENT_BOARD_IS_ACTIVE_OUTPUT)
-        restore_leds(&global_state);
+    if (state->keyboard_connected && CURRENT_BOARD_IS_ACTIVE_OUTPUT)
+        restore_leds(state);
 
     /* Always send to the other one, so it is aware of the change */
     send_value(leds, KBD_SET_REPORT_MSG);
 }
 
+/* Runs on core1, processes set reports received from the computer on core0 */
+void process_set_report_task(device_t *state) {
+    hid_generic_pkt_t *report;
+
+    while ((report = ring_front(&state->set_report_queue)) != NULL) {
+        handle_set_report(report, state);
+        ring_release(&state->set_report_queue);
+    }
+}
+
 /* Invoked when device is mounted */
 void tud_mount_cb(void) {
     global_state.tud_connected = true;
@@ -110,6 +143,9 @@ void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance) {
             break;
     }
 
+    /* If it was a pointer holding a button, release it */
+    release_mouse_source(&global_state, iface - &global_state.iface[0][0]);
+
     /* Also clear the interface structure, otherwise plugging something else later
        might be a fun (and confusing) experience */
     memset(iface, 0, sizeof(hid_interface_t));
@@ -133,6 +169,9 @@ void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *desc_re
     /* Parse the report descriptor into our internal structure. */
     parse_report_descriptor(iface, desc_report, desc_len);
 
+    /* Start measuring the report rate from scratch for the new device */
+    reset_report_rate(&global_state.report_rate[dev_addr-1][instance]);
+
     switch (itf_protocol) {
         case HID_ITF_PROTOCOL_KEYBOARD:
             if (global_state.config.enforce_ports && BOARD_ROLE == OUTPUT_B)
@@ -184,6 +223,9 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
     if (instance >= MAX_INTERFACES)
         return;
 
+    report_rate_t *rate = &global_state.report_rate[dev_addr-1][instance];
+    record_report_arrival(rate, time_us_32());
+
     /* Calculate a device index that distinguishes between different devices
        while staying within the bounds of MAX_DEVICES.
 
@@ -232,6 +274,8 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
         process_mouse_report((uint8_t *)report, len, device_idx, iface);
     }
 
+    record_report_processed(rate, time_us_32());
+
     /* Continue requesting reports */
     tuh_hid_receive_report(dev_addr, instance);
 }
@@ -93,6 +93,9 @@ void load_config(device_t *state) {
     /* On any condition failing, we fall back to default config */
     if (magic_header_fail || checksum_fail || version_fail)
         memcpy(running_config, &default_config, sizeof(config_t));
+
+    /* Hotkeys are matched through lookup masks built from the config table */
+    compile_hotkeys(state);
 }
 
 void save_config(device_t *state) {
@@ -152,48 +155,112 @@ uint32_t get_ptr_delta(uint32_t current_pointer, device_t *state) {
     else
         delta = DMA_RX_BUFFER_SIZE - state->dma_ptr + current_pointer;
 
-    /* Clamp to 12 bits since it can never be bigger */
+    /* Clamp to 10 bits since it can never be bigger, packet_receiver_task() catches the
+       DMA lapping us, which this can't tell apart from a small delta */
     delta = delta & 0x3FF;
 
     return delta;
 }
 
+/* Copy bytes out of the RX ring, only a frame straddling the end of the ring needs two copies */
+void copy_from_rx_ring(uint8_t *dst, uint32_t idx, uint32_t length) {
+    uint32_t contiguous = DMA_RX_BUFFER_SIZE - idx;
+
+    if (length <= contiguous) {
+        memcpy(dst, &uart_rxbuf[idx], length);
+    } else {
+        memcpy(dst, &uart_rxbuf[idx], contiguous);
+        memcpy(dst + contiguous, uart_rxbuf, length - contiguous);
+    }
+}
+
 void fetch_packet(device_t *state) {
-    uint8_t *dst = (uint8_t *)&state->in_packet;
+    /* Skip the header preamble */
+    uint32_t idx = (state->dma_ptr + START_LENGTH) & (DMA_RX_BUFFER_SIZE - 1);
+
+    copy_from_rx_ring((uint8_t *)&state->in_packet, idx, RAW_PACKET_LENGTH - START_LENGTH);
+    consume_rx_bytes(state, RAW_PACKET_LENGTH);
+}
+
+/* Move the RX position forward, rx_consumed keeps counting where dma_ptr wraps around */
+void consume_rx_bytes(device_t *state, uint32_t length) {
+    state->dma_ptr = (state->dma_ptr + length) & (DMA_RX_BUFFER_SIZE - 1);
+    state->rx_consumed += length;
+}
+
+/* Nonzero if any byte of the word is zero */
+#define HAS_ZERO_BYTE(word) (((word) - 0x01010101u) & ~(word) & 0x80808080u)
+#define START1_WORD         (START1 * 0x01010101u)
+
+/* Offset of the first possible frame start in the ring span, or -1 if there is none. Frames
+   start with the legacy preamble or right after a COBS delimiter. The bad frame we're skipping
+   starts at the current position, so a preamble there doesn't count. */
+static int32_t scan_rx_span(uint32_t idx, uint32_t length, bool at_current) {
+    uint32_t i = 0;
+
+    while (i < length) {
+        /* Whole words where no byte is a preamble or a delimiter are skipped at once */
+        if (((idx + i) & 3) == 0 && i + 4 <= length) {
+            uint32_t word = *(uint32_t *)&uart_rxbuf[idx + i];
 
-    for (int i = 0; i < RAW_PACKET_LENGTH; i++) {
-        /* Skip the header preamble */
-        if (i >= START_LENGTH)
-            dst[i - START_LENGTH] = uart_rxbuf[state->dma_ptr];
+            if (!HAS_ZERO_BYTE(word) && !HAS_ZERO_BYTE(word ^ START1_WORD)) {
+                i += 4;
+                continue;
+            }
+        }
 
-        state->dma_ptr = NEXT_RING_IDX(state->dma_ptr);
+        uint8_t byte = uart_rxbuf[idx + i];
+
+        if (byte == COBS_DELIMITER)
+            return i + 1;
+
+        if (byte == START1 && (i > 0 || !at_current))
+            return i;
+
+        i++;
     }
+
+    return -1;
+}
+
+/* After a frame at the current RX position turned out bad, returns how many bytes to skip
+   to get to the next place a frame could start, up to all of the available bytes. */
+uint32_t find_frame_start(device_t *state, uint32_t available) {
+    uint32_t contiguous = DMA_RX_BUFFER_SIZE - state->dma_ptr;
+    uint32_t first      = available < contiguous ? available : contiguous;
+    int32_t offset      = scan_rx_span(state->dma_ptr, first, true);
+
+    if (offset >= 0)
+        return offset;
+
+    if (available <= contiguous)
+        return available;
+
+    /* Continue from the start of the ring */
+    offset = scan_rx_span(0, available - contiguous, false);
+    return offset >= 0 ? contiguous + offset : available;
 }
 
 /* Validating any input is mandatory. Only packets of these type are allowed
    to be sent to the device over configuration endpoint. */
 bool validate_packet(uart_packet_t *packet) {
-    const enum packet_type_e ALLOWED_PACKETS[] = {
-        FLASH_LED_MSG,
-        GET_VAL_MSG,
-        GET_ALL_VALS_MSG,
-        SET_VAL_MSG,
-        WIPE_CONFIG_MSG,
-        SAVE_CONFIG_MSG,
-        REBOOT_MSG,
-        PROXY_PACKET_MSG,
-    };
     uint8_t packet_type = packet->type;
+    uint8_t *data       = packet->data;
 
     /* Proxied packets are encapsulated in the data field, but same rules apply */
     if (packet->type == PROXY_PACKET_MSG)
-        packet_type = packet->data[0];
+        packet_type = *data++;
 
-    for (int i = 0; i < ARRAY_SIZE(ALLOWED_PACKETS); i++) {
-        if (ALLOWED_PACKETS[i] == packet_type)
-            return true;
-    }
-    return false;
+    /* Allowed ones are marked in MESSAGE_REGISTRY */
+    const message_t *message = get_message(packet_type);
+    if (message == NULL || !message->from_host)
+        return false;
+
+    /* The boards negotiate link speed between themselves, the host may only ask for it */
+    if (packet_type == LINK_TRAIN_MSG && data[LINK_TRAIN_OP_IDX] != LINK_TRAIN_START)
+        return false;
+
+    return true;
 }
 
 /* Stub for external libraries that call debug printf */
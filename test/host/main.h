@@ -0,0 +1,24 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+#pragma once
+
+/* Stands in for src/include/main.h when firmware sources are built on the host for tests,
+   provides just the few SDK bits they use. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ring.h"
+
+#define __dmb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+uint32_t time_us_32(void);
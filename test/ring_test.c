@@ -0,0 +1,441 @@
+/*
+ * This file is part of DeskHop (https://github.com/hrvach/deskhop).
+ * Copyright (c) 2025 Hrvoje Cavrak
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * See the file LICENSE for the full license text.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "main.h"
+
+/* ================================================== *
+ * ==================  Test Helpers  ================ *
+ * ================================================== */
+
+#define RING_LENGTH    16
+#define STRESS_ELEMENTS 500000
+
+static int failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                    \
+        }                                                                  \
+    } while (0)
+
+uint32_t time_us_32(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000u + now.tv_nsec / 1000;
+}
+
+/* Element with redundant copies of its sequence number, so a torn read shows up */
+typedef struct {
+    uint32_t seq;
+    uint32_t copies[3];
+} element_t;
+
+static element_t storage[RING_LENGTH];
+static uint32_t stamps[RING_LENGTH];
+
+static element_t make_element(uint32_t seq) {
+    return (element_t){.seq = seq, .copies = {seq, ~seq, seq * 2654435761u}};
+}
+
+static bool is_intact(const element_t *element) {
+    uint32_t seq = element->seq;
+    return element->copies[0] == seq && element->copies[1] == ~seq && element->copies[2] == seq * 2654435761u;
+}
+
+/* Elements in the same group of four supersede each other, the newest one is kept */
+static bool merge_group(void *newest, const void *element) {
+    element_t *queued     = newest;
+    const element_t *next = element;
+
+    if (queued->seq / 4 != next->seq / 4)
+        return false;
+
+    *queued = *next;
+    return true;
+}
+
+static void add_elements(ring_t *ring, uint32_t first, uint32_t count) {
+    for (uint32_t seq = first; seq < first + count; seq++) {
+        element_t element = make_element(seq);
+        ring_try_add(ring, &element);
+    }
+}
+
+/* ================================================== *
+ * ==============  Single Thread Tests  ============= *
+ * ================================================== */
+
+static void test_fifo_order(void) {
+    ring_t ring;
+    element_t element;
+
+    ring_init(&ring, storage, stamps, sizeof(element_t), RING_LENGTH, RING_DROP_NEWEST);
+
+    /* Go around the ring a few times, a few elements at a time */
+    for (uint32_t seq = 0; seq < 5 * RING_LENGTH; seq += 3) {
+        add_elements(&ring, seq, 3);
+
+        for (uint32_t i = 0; i < 3; i++) {
+            CHECK(ring_try_remove(&ring, &element));
+            CHECK(element.seq == seq + i && is_intact(&element));
+        }
+    }
+
+    CHECK(ring_is_empty(&ring));
+    CHECK(!ring_try_remove(&ring, &element));
+}
+
+static void test_claim_in_place(void) {
+    ring_t ring;
+
+    ring_init(&ring, storage, stamps, sizeof(element_t), RING_LENGTH, RING_DROP_NEWEST);
+
+    element_t *slot = ring_claim(&ring);
+    CHECK(slot != NULL);
+
+    /* Nothing is visible before commit */
+    *slot = make_element(7);
+    CHECK(ring_front(&ring) == NULL);
+
+    ring_commit(&ring);
+
+    element_t *front = ring_front(&ring);
+    CHECK(front != NULL && front->seq == 7);
+
+    ring_release(&ring);
+    CHECK(ring_is_empty(&ring));
+}
+
+static void test_drop_newest(void) {
+    ring_t ring;
+    element_t element;
+
+    ring_init(&ring, storage, stamps, sizeof(element_t), RING_LENGTH, RING_DROP_NEWEST);
+
+    /* Everything fits, then the newest ones are refused */
+    add_elements(&ring, 0, RING_LENGTH + 5);
+
+    CHECK(ring_level(&ring) == RING_LENGTH);
+    CHECK(ring.stats.enqueued == RING_LENGTH);
+    CHECK(ring.stats.dropped == 5);
+
+    for (uint32_t seq = 0; seq < RING_LENGTH; seq++) {
+        CHECK(ring_try_remove(&ring, &element));
+        CHECK(element.seq == seq);
+    }
+
+    CHECK(ring_is_empty(&ring));
+}
+
+static void test_drop_oldest(void) {
+    ring_t ring;
+    element_t element;
+    uint32_t limit = RING_LENGTH - RING_LENGTH / 4;
+
+    ring_init(&ring, storage, stamps, sizeof(element_t), RING_LENGTH, RING_DROP_OLDEST);
+
+    /* Up to the soft limit nothing is lost */
+    add_elements(&ring, 0, limit);
+    CHECK(ring.stats.dropped == 0);
+
+    /* Past it, the oldest ones are skipped and the newest limit elements are kept */
+    add_elements(&ring, limit, 3);
+    CHECK(ring.stats.dropped == 3);
+
+    for (uint32_t seq = 3; seq < limit + 3; seq++) {
+        CHECK(ring_try_remove(&ring, &element));
+        CHECK(element.seq == seq);
+    }
+
+    CHECK(!ring_try_remove(&ring, &element));
+}
+
+static void test_snapshot(void) {
+    ring_t ring;
+    element_t element;
+    uint32_t limit = RING_LENGTH - RING_LENGTH / 4;
+
+    ring_init(&ring, storage, stamps, sizeof(element_t), RING_LENGTH, RING_SNAPSHOT);
+
+    /* Below the soft limit every element is delivered */
+    add_elements(&ring, 0, 3);
+
+    for (uint32_t seq = 0; seq < 3; seq++) {
+        CHECK(ring_try_remove(&ring, &element));
+        CHECK(element.seq == seq);
+    }
+
+    /* Past it, the backlog collapses to the newest element */
+    add_elements(&ring, 100, limit + 1);
+
+    CHECK(ring_try_remove(&ring, &element));
+    CHECK(element.seq == 100 + limit);
+    CHECK(ring_is_empty(&ring));
+    CHECK(ring.stats.dropped == limit);
+}
+
+/* Consumer stalled, e.g. the host is suspended. The producer keeps going long past the
+   capacity, and the newest elements must still be the ones delivered. */
+static void test_stalled_consumer(ring_policy_e policy, uint32_t kept) {
+    ring_t ring;
+    element_t element;
+    uint32_t count = 10 * RING_LENGTH + 3;
+
+    ring_init(&ring, storage, stamps, sizeof(element_t), RING_LENGTH, policy);
+
+    for (uint32_t seq = 0; seq < count; seq++) {
+        element = make_element(seq);
+        CHECK(ring_try_add(&ring, &element));
+    }
+
+    CHECK(ring_level(&ring) == RING_LENGTH);
+
+    for (uint32_t seq = count - kept; seq < count; seq++) {
+        CHECK(ring_try_remove(&ring, &element));
+        CHECK(element.seq == seq && is_intact(&element));
+    }
+
+    CHECK(ring_is_empty(&ring));
+    CHECK(ring.stats.dropped == count - kept);
+}
+
+/* Slot the consumer is looking at stays untouched, even once it's superseded */
+static void test_reading_slot_kept(void) {
+    ring_t ring;
+    element_t element;
+
+    ring_init(&ring, storage, stamps, sizeof(element_t), RING_LENGTH, RING_SNAPSHOT);
+
+    add_elements(&ring, 0, 1);
+
+    element_t *front = ring_front(&ring);
+    CHECK(front != NULL && front->seq == 0);
+
+    /* Producer fills the ring behind it, then can't reuse the slot being read */
+    for (uint32_t seq = 1; seq < RING_LENGTH; seq++) {
+        element = make_element(seq);
+        CHECK(ring_try_add(&ring, &element));
+    }
+
+    element = make_element(RING_LENGTH);
+    CHECK(!ring_try_add(&ring, &element));
+    CHECK(front->seq == 0 && is_intact(front));
+
+    /* Endpoint was busy, once the consumer lets go the producer can go on */
+    ring_keep(&ring);
+    CHECK(ring_try_add(&ring, &element));
+
+    CHECK(ring_try_remove(&ring, &element));
+    CHECK(element.seq == RING_LENGTH);
+    CHECK(ring_is_empty(&ring));
+}
+
+static void test_merge(void) {
+    ring_t ring;
+    element_t element;
+
+    ring_init(&ring, storage, stamps, sizeof(element_t), RING_LENGTH, RING_MERGE);
+    ring_set_merge(&ring, merge_group);
+
+    /* A whole group ends up as one element */
+    add_elements(&ring, 0, 4);
+    CHECK(ring_level(&ring) == 1);
+
+    element_t *front = ring_front(&ring);
+    CHECK(front != NULL && front->seq == 3 && is_intact(front));
+
+    /* Slot the consumer is on isn't merged into, the element is added on its own */
+    add_elements(&ring, 2, 1);
+    CHECK(ring_level(&ring) == 2);
+    CHECK(front->seq == 3 && is_intact(front));
+
+    /* Once it lets go, the newest element is merged into again */
+    ring_keep(&ring);
+    add_elements(&ring, 1, 1);
+    CHECK(ring_level(&ring) == 2);
+
+    CHECK(ring_try_remove(&ring, &element) && element.seq == 3);
+    CHECK(ring_try_remove(&ring, &element) && element.seq == 1);
+    CHECK(ring_is_empty(&ring));
+
+    /* A full ring refuses new groups, but still merges into the newest one */
+    for (uint32_t group = 0; group < RING_LENGTH; group++)
+        add_elements(&ring, group * 4, 1);
+
+    element = make_element(RING_LENGTH * 4);
+    CHECK(!ring_try_add(&ring, &element));
+
+    element = make_element((RING_LENGTH - 1) * 4 + 1);
+    CHECK(ring_try_add(&ring, &element));
+    CHECK(ring_level(&ring) == RING_LENGTH);
+
+    for (uint32_t group = 0; group < RING_LENGTH; group++) {
+        CHECK(ring_try_remove(&ring, &element));
+        CHECK(element.seq == group * 4 + (group == RING_LENGTH - 1));
+    }
+
+    CHECK(ring_is_empty(&ring));
+}
+
+/* ================================================== *
+ * =============  Producer vs. Consumer  ============ *
+ * ================================================== */
+
+typedef struct {
+    ring_t ring;
+    bool retry;              // Producer waits for space instead of dropping
+    volatile bool done;      // Producer finished
+    uint32_t last_produced;  // Sequence number of the last element committed
+} stress_t;
+
+static void *stress_producer(void *arg) {
+    stress_t *stress = arg;
+
+    for (uint32_t seq = 1; seq <= STRESS_ELEMENTS; seq++) {
+        element_t *slot;
+
+        /* Merging only happens when adding a complete element */
+        if (stress->ring.policy == RING_MERGE) {
+            element_t element = make_element(seq);
+
+            while (!ring_try_add(&stress->ring, &element))
+                sched_yield();
+
+            stress->last_produced = seq;
+            continue;
+        }
+
+        /* Let the consumer run, the test machine might have a single CPU */
+        while ((slot = ring_claim(&stress->ring)) == NULL && stress->retry)
+            sched_yield();
+
+        if (slot == NULL)
+            continue;
+
+        *slot = make_element(seq);
+        ring_commit(&stress->ring);
+        stress->last_produced = seq;
+    }
+
+    __dmb();
+    stress->done = true;
+    return NULL;
+}
+
+/* Sequence number of the last element committed in the last run_stress() */
+static uint32_t run_last_produced;
+
+/* Runs the consumer on this thread, returns the number of elements received */
+static uint32_t run_stress(ring_policy_e policy, bool retry, uint32_t *last_received) {
+    static stress_t stress;
+    pthread_t producer;
+    uint32_t received = 0, expected = 1;
+    bool in_order = true, intact = true;
+
+    memset(&stress, 0, sizeof(stress));
+    ring_init(&stress.ring, storage, stamps, sizeof(element_t), RING_LENGTH, policy);
+    ring_set_merge(&stress.ring, merge_group);
+    stress.retry = retry;
+
+    pthread_create(&producer, NULL, stress_producer, &stress);
+
+    while (true) {
+        bool done = stress.done;
+        __dmb();
+
+        element_t *element = ring_front(&stress.ring);
+
+        if (element == NULL) {
+            if (done)
+                break;
+            sched_yield();
+            continue;
+        }
+
+        intact &= is_intact(element);
+
+        /* Without drops or merges every element arrives, otherwise they still arrive in order */
+        in_order &= (retry && policy != RING_MERGE) ? element->seq == expected : element->seq >= expected;
+        expected = element->seq + 1;
+        *last_received = element->seq;
+        received++;
+
+        ring_release(&stress.ring);
+    }
+
+    pthread_join(producer, NULL);
+    run_last_produced = stress.last_produced;
+
+    CHECK(intact);
+    CHECK(in_order);
+    return received;
+}
+
+static void test_stress_drop_newest(void) {
+    uint32_t last = 0;
+
+    CHECK(run_stress(RING_DROP_NEWEST, true, &last) == STRESS_ELEMENTS);
+    CHECK(last == STRESS_ELEMENTS);
+}
+
+/* With the skipping policies, the last element committed is always delivered */
+static void test_stress_drop_oldest(void) {
+    uint32_t last = 0;
+
+    CHECK(run_stress(RING_DROP_OLDEST, false, &last) > 0);
+    CHECK(last == run_last_produced);
+}
+
+static void test_stress_snapshot(void) {
+    uint32_t last = 0;
+
+    CHECK(run_stress(RING_SNAPSHOT, false, &last) > 0);
+    CHECK(last == run_last_produced);
+}
+
+/* Merged elements are never torn, and the newest one always makes it */
+static void test_stress_merge(void) {
+    uint32_t last = 0;
+
+    CHECK(run_stress(RING_MERGE, true, &last) > 0);
+    CHECK(last == STRESS_ELEMENTS);
+}
+
+int main(void) {
+    test_fifo_order();
+    test_claim_in_place();
+    test_drop_newest();
+    test_drop_oldest();
+    test_snapshot();
+    test_stalled_consumer(RING_DROP_OLDEST, RING_LENGTH - RING_LENGTH / 4);
+    test_stalled_consumer(RING_SNAPSHOT, 1);
+    test_reading_slot_kept();
+    test_merge();
+    test_stress_drop_newest();
+    test_stress_drop_oldest();
+    test_stress_snapshot();
+    test_stress_merge();
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("All ring tests passed\n");
+    return 0;
+}